@@ -149,6 +149,12 @@ CREATE TABLE engine (
 );
 ALTER SEQUENCE engine_id_seq OWNED BY engine.engine_id;
 
+-- Trigram indexes backing the fuzzy engine search, which ranks engines by the
+-- similarity of their name or notes to what was typed.
+CREATE EXTENSION IF NOT EXISTS pg_trgm SCHEMA engine;
+CREATE INDEX engine_name_trgm_idx ON engine USING gin (engine_name gin_trgm_ops);
+CREATE INDEX engine_note_trgm_idx ON engine USING gin (note gin_trgm_ops);
+
 -- A table storing information about the authors of chess engines.
 CREATE SEQUENCE author_id_seq AS int;
 CREATE TABLE author (
@@ -176,12 +182,15 @@ CREATE TABLE source (
 ALTER SEQUENCE source_id_seq OWNED BY source.source_id;
 
 -- A table storing engine logos and their associated engines.
--- Modifying this is done with external tools.
+-- Logos are imported and exported through the large object API, and the size
+-- and hash let unchanged logos be detected without reading logo_img.
 CREATE SEQUENCE logo_id_seq AS int;
 CREATE TABLE logo (
-    logo_id   int PRIMARY KEY DEFAULT nextval('logo_id_seq'),
-    engine_id int REFERENCES engine (engine_id),
-    logo_img  bytea DEFAULT NULL
+    logo_id     int PRIMARY KEY DEFAULT nextval('logo_id_seq'),
+    engine_id   int REFERENCES engine (engine_id),
+    logo_img    bytea DEFAULT NULL,
+    logo_size   int GENERATED ALWAYS AS (octet_length(logo_img)) STORED,
+    logo_sha256 bytea GENERATED ALWAYS AS (sha256(logo_img)) STORED
 );
 ALTER SEQUENCE logo_id_seq OWNED BY logo.logo_id;
 
@@ -229,6 +238,16 @@ CREATE TABLE inspiration (
 );
 ALTER SEQUENCE inspiration_id_seq OWNED BY inspiration.inspiration_id;
 
+-- A table storing each distinct PKGBUILD once, keyed by the SHA-256 hash of its
+-- text, so versions with identical PKGBUILDs share a single row.
+-- content is compressed with zlib when that makes it smaller.
+CREATE TABLE pkgbuild (
+    pkgbuild_hash  bytea PRIMARY KEY,     -- The SHA-256 hash of the uncompressed text.
+    is_compressed  bool NOT NULL,         -- Is content compressed with zlib?
+    pkgbuild_size  int NOT NULL,          -- The size of the uncompressed text in bytes.
+    content        bytea NOT NULL
+);
+
 -- A table relating engines to all of their versions and their properties.
 -- Kept seperate from engines since there are an unknown amount of versions.
 -- Some engines might change language, such as Prophet, which converted from C++ to C.
@@ -246,11 +265,86 @@ CREATE TABLE version (
     is_xboard     bool NOT NULL,          -- Can the program interface with Xboard?
     is_uci        bool NOT NULL,          -- Can the program interface with UCI?
     note          text,                   -- Custom documentation/notes.
-    pkgbuild      text,                   -- A file which can build the engine from source.
+    pkgbuild_hash bytea REFERENCES pkgbuild (pkgbuild_hash), -- A file which can build the engine from source.
     UNIQUE (engine_id, version_name)
 );
 ALTER SEQUENCE version_id_seq OWNED BY version.version_id;
 
+-- A summary of the latest version of each engine, kept up to date by the
+-- triggers on version below, so looking up an engine's latest release is a
+-- single index read instead of a sort over all of its versions.
+CREATE TABLE latest_version (
+    engine_id     int PRIMARY KEY REFERENCES engine (engine_id) ON DELETE CASCADE,
+    version_id    int NOT NULL REFERENCES version (version_id) ON DELETE CASCADE,
+    version_name  varchar(255) NOT NULL,
+    release_date  date NOT NULL,
+    code_lang_id  int REFERENCES code_lang (code_lang_id),
+    license_id    int REFERENCES license (license_id)
+);
+
+-- Recomputes the latest versions of the given engines. Rows are updated in
+-- place rather than deleted and inserted again, so two transactions adding
+-- versions of the same engine cannot both insert its row.
+CREATE FUNCTION refresh_latest_version(engine_ids int[]) RETURNS void AS $$
+    DELETE FROM latest_version l WHERE l.engine_id = ANY (engine_ids)
+    AND NOT EXISTS (SELECT 1 FROM version v WHERE v.engine_id = l.engine_id);
+    INSERT INTO latest_version (engine_id, version_id, version_name,
+                                release_date, code_lang_id, license_id)
+    SELECT DISTINCT ON (engine_id) engine_id, version_id, version_name,
+           release_date, code_lang_id, license_id
+    FROM version WHERE engine_id = ANY (engine_ids)
+    ORDER BY engine_id, release_date DESC, version_id DESC
+    ON CONFLICT (engine_id) DO UPDATE SET
+        version_id = EXCLUDED.version_id, version_name = EXCLUDED.version_name,
+        release_date = EXCLUDED.release_date,
+        code_lang_id = EXCLUDED.code_lang_id, license_id = EXCLUDED.license_id;
+$$ LANGUAGE sql SET search_path = engine;
+
+-- Recomputes the latest versions of every engine, for when the triggers were
+-- bypassed (e.g. by pg_restore --disable-triggers).
+CREATE FUNCTION refresh_latest_version() RETURNS void AS $$
+    DELETE FROM latest_version l
+    WHERE NOT EXISTS (SELECT 1 FROM version v WHERE v.engine_id = l.engine_id);
+    INSERT INTO latest_version (engine_id, version_id, version_name,
+                                release_date, code_lang_id, license_id)
+    SELECT DISTINCT ON (engine_id) engine_id, version_id, version_name,
+           release_date, code_lang_id, license_id
+    FROM version WHERE engine_id IS NOT NULL
+    ORDER BY engine_id, release_date DESC, version_id DESC
+    ON CONFLICT (engine_id) DO UPDATE SET
+        version_id = EXCLUDED.version_id, version_name = EXCLUDED.version_name,
+        release_date = EXCLUDED.release_date,
+        code_lang_id = EXCLUDED.code_lang_id, license_id = EXCLUDED.license_id;
+$$ LANGUAGE sql SET search_path = engine;
+
+-- Statement-level, so a bulk insert refreshes each engine once.
+CREATE FUNCTION version_refresh_latest() RETURNS trigger AS $$
+BEGIN
+    IF TG_OP = 'INSERT' THEN
+        PERFORM refresh_latest_version(
+            ARRAY(SELECT DISTINCT engine_id FROM new_rows));
+    ELSIF TG_OP = 'DELETE' THEN
+        PERFORM refresh_latest_version(
+            ARRAY(SELECT DISTINCT engine_id FROM old_rows));
+    ELSE
+        PERFORM refresh_latest_version(
+            ARRAY(SELECT engine_id FROM new_rows
+                  UNION SELECT engine_id FROM old_rows));
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql SET search_path = engine;
+
+CREATE TRIGGER version_insert_latest AFTER INSERT ON version
+    REFERENCING NEW TABLE AS new_rows
+    FOR EACH STATEMENT EXECUTE FUNCTION version_refresh_latest();
+CREATE TRIGGER version_update_latest AFTER UPDATE ON version
+    REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+    FOR EACH STATEMENT EXECUTE FUNCTION version_refresh_latest();
+CREATE TRIGGER version_delete_latest AFTER DELETE ON version
+    REFERENCING OLD TABLE AS old_rows
+    FOR EACH STATEMENT EXECUTE FUNCTION version_refresh_latest();
+
 -- A table relating engines to the operating systems they can be built and ran on.
 -- The contents come entirely from my own testing, so Linux will be the main representative.
 CREATE SEQUENCE version_os_id_seq AS int;
@@ -270,3 +364,123 @@ CREATE TABLE version_egtb (
     egtb_id     int REFERENCES egtb (egtb_id)
 );
 ALTER SEQUENCE version_egtb_id_seq OWNED BY version_egtb.version_egtb_id;
+
+-- The outcome and measurements of every build of a version run by engine-db-cli.
+-- finished_at is NULL while the build runs, or if it was interrupted, and the
+-- measurements are NULL where they could not be taken.
+CREATE SEQUENCE build_id_seq AS int;
+CREATE TABLE build (
+    build_id      int PRIMARY KEY DEFAULT nextval('build_id_seq'),
+    version_id    int REFERENCES version (version_id) ON DELETE CASCADE,
+    started_at    timestamptz NOT NULL DEFAULT now(),
+    finished_at   timestamptz,
+    exit_status   int,    -- The exit status of pkg-run-makepkg.sh, or the signal which killed it, negated.
+    wall_ms       int,    -- Elapsed time of the whole build.
+    cpu_ms        int,    -- User and system time of the build and every process it ran.
+    max_rss_kb    int,    -- Peak resident memory of the largest process of the build.
+    binary_size   bigint,
+    binary_sha256 bytea,
+    compiler      text,   -- The first line of the compiler's --version.
+    binary_path   text,
+    cache_key     bytea,  -- The hash of the source revision, PKGBUILD and toolchain built, or NULL if the build may not be reused.
+    isolation     text,   -- cgroup if the limits applied to the whole build, or rlimit if to each of its processes.
+    mem_limit_mb  int,
+    cpu_limit_pct int,    -- Percent of one core, or NULL if the CPU share was not limited.
+    time_limit_s  int,
+    timed_out     bool NOT NULL DEFAULT false, -- Was the build killed for running past time_limit_s?
+    variant       text NOT NULL DEFAULT 'generic', -- The compiler flags built with: generic, native, lto or pgo.
+    bench_nps     bigint  -- Nodes per second reported by the binary's bench command, if it has one.
+);
+ALTER SEQUENCE build_id_seq OWNED BY build.build_id;
+CREATE INDEX build_version_idx ON build (version_id);
+CREATE INDEX build_cache_key_idx ON build (cache_key) WHERE cache_key IS NOT NULL;
+
+-- The content-addressed store of build artifacts under Engines/.store, with
+-- one row per distinct file kept there.
+CREATE TABLE artifact (
+    artifact_sha256 bytea PRIMARY KEY,
+    artifact_size   bigint NOT NULL,
+    stored_at       timestamptz NOT NULL DEFAULT now()
+);
+
+-- The files each build left under Engines/, which are hard links to the
+-- stored artifact with the same content.
+CREATE TABLE build_artifact (
+    build_id        int REFERENCES build (build_id) ON DELETE CASCADE,
+    artifact_sha256 bytea NOT NULL REFERENCES artifact (artifact_sha256),
+    path            text NOT NULL,
+    PRIMARY KEY (build_id, path)
+);
+CREATE INDEX build_artifact_sha256_idx ON build_artifact (artifact_sha256);
+
+-- The size of the sources of each version by language, counted by engine-db-cli
+-- from the files of the commit its revision referred to.
+CREATE TABLE version_lang_stat (
+    version_id    int REFERENCES version (version_id) ON DELETE CASCADE,
+    code_lang_id  int REFERENCES code_lang (code_lang_id),
+    commit_id     text NOT NULL,  -- The commit counted, so unchanged sources are not counted again.
+    file_count    int NOT NULL,
+    line_count    bigint NOT NULL,
+    byte_count    bigint NOT NULL,
+    PRIMARY KEY (version_id, code_lang_id)
+);
+
+-- A denormalized view of the catalog with one row per version, and one row per
+-- source (or engine without sources) no version is built from.
+-- The columns match the columns accepted by the bulk import of engine-db-cli,
+-- so an export of this view can be imported into another database.
+CREATE VIEW catalog AS
+SELECT engine_name, e.note AS engine_note, a.author_name, source_uri, vcs_name,
+       version_name, frag_type, frag_val, release_date, code_lang_name,
+       license_name, is_xboard, is_uci, v.note AS version_note
+FROM engine e
+CROSS JOIN LATERAL (
+    SELECT string_agg(author_name, ';' ORDER BY author_name) AS author_name
+    FROM engine_author JOIN author USING (author_id)
+    WHERE engine_id = e.engine_id) a
+JOIN version v USING (engine_id)
+-- Neither a version's revision nor a revision's source is required, and the
+-- version is listed without them rather than left out.
+LEFT JOIN revision USING (revision_id)
+LEFT JOIN source USING (source_id)
+LEFT JOIN vcs USING (vcs_id)
+LEFT JOIN code_lang USING (code_lang_id)
+LEFT JOIN license USING (license_id)
+UNION ALL
+SELECT engine_name, e.note, a.author_name, s.source_uri, s.vcs_name,
+       NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+FROM engine e
+CROSS JOIN LATERAL (
+    SELECT string_agg(author_name, ';' ORDER BY author_name) AS author_name
+    FROM engine_author JOIN author USING (author_id)
+    WHERE engine_id = e.engine_id) a
+LEFT JOIN (engine_source JOIN source USING (source_id) JOIN vcs USING (vcs_id)) s
+    USING (engine_id)
+WHERE NOT EXISTS (
+    SELECT 1 FROM version v LEFT JOIN revision r USING (revision_id)
+    WHERE v.engine_id = e.engine_id AND r.source_id IS NOT DISTINCT FROM s.source_id);
+
+-- Notifies every listening client that a table changed, so clients which cache
+-- query results (see the C command of engine-db-cli) can drop them.
+CREATE FUNCTION notify_cache() RETURNS trigger AS $$
+BEGIN
+    PERFORM pg_notify('engine_db_cache', TG_TABLE_NAME);
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+DO $$
+DECLARE
+    t text;
+BEGIN
+    FOREACH t IN ARRAY ARRAY['engine', 'author', 'engine_author', 'source',
+                             'engine_source', 'vcs', 'revision', 'version',
+                             'code_lang', 'license', 'os', 'version_os',
+                             'egtb', 'version_egtb'] LOOP
+        EXECUTE format('CREATE TRIGGER %I AFTER INSERT OR UPDATE OR DELETE '
+                       'OR TRUNCATE ON %I FOR EACH STATEMENT '
+                       'EXECUTE FUNCTION notify_cache();',
+                       t || '_notify_cache', t);
+    END LOOP;
+END;
+$$;
@@ -0,0 +1,29 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+-- Adds the size and hash of each logo to a database made before they were
+-- stored with it, which logo import and export rely on. Run it once, with
+-- psql -d engine_db -f Migrate-Logo.sql
+-- Adding the columns computes them for every logo already stored.
+SET search_path TO engine;
+BEGIN;
+
+ALTER TABLE logo ADD COLUMN IF NOT EXISTS
+    logo_size int GENERATED ALWAYS AS (octet_length(logo_img)) STORED;
+ALTER TABLE logo ADD COLUMN IF NOT EXISTS
+    logo_sha256 bytea GENERATED ALWAYS AS (sha256(logo_img)) STORED;
+
+COMMIT;
@@ -0,0 +1,45 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+-- Moves the PKGBUILDs of a database made before they were kept in the pkgbuild
+-- table out of version.pkgbuild and into it. Run it once, with
+-- psql -d engine_db -f Migrate-Pkgbuild.sql
+-- The PKGBUILDs are stored uncompressed. Storing one again with engine-db-cli
+-- compresses it if that makes it smaller.
+SET search_path TO engine;
+BEGIN;
+
+CREATE TABLE IF NOT EXISTS pkgbuild (
+    pkgbuild_hash  bytea PRIMARY KEY,     -- The SHA-256 hash of the uncompressed text.
+    is_compressed  bool NOT NULL,         -- Is content compressed with zlib?
+    pkgbuild_size  int NOT NULL,          -- The size of the uncompressed text in bytes.
+    content        bytea NOT NULL
+);
+ALTER TABLE version ADD COLUMN IF NOT EXISTS
+    pkgbuild_hash bytea REFERENCES pkgbuild (pkgbuild_hash);
+
+-- The hash is of the text as engine-db-cli reads it from the file, which is
+-- the text in the database's encoding.
+INSERT INTO pkgbuild (pkgbuild_hash, is_compressed, pkgbuild_size, content)
+SELECT DISTINCT sha256(convert_to(pkgbuild, 'UTF8')), false,
+       octet_length(convert_to(pkgbuild, 'UTF8')), convert_to(pkgbuild, 'UTF8')
+FROM version WHERE pkgbuild IS NOT NULL
+ON CONFLICT (pkgbuild_hash) DO NOTHING;
+UPDATE version SET pkgbuild_hash = sha256(convert_to(pkgbuild, 'UTF8'))
+WHERE pkgbuild IS NOT NULL;
+ALTER TABLE version DROP COLUMN pkgbuild;
+
+COMMIT;
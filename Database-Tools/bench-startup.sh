@@ -0,0 +1,53 @@
+#!/usr/bin/env sh
+# Copyright 2023 En-En-Code
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Measures how long engine-db-cli takes to start, run and exit for common
+# commands, averaged over a number of runs.
+# Usage: bench-startup.sh [CONNINFO] [RUNS]
+
+CONNINFO=${1:-dbname=engine_db}
+RUNS=${2:-20}
+EXEC=./engine-db-cli
+
+if [ ! -x "$EXEC" ]; then
+	echo "$EXEC not built."
+	exit 1
+fi
+
+# Runs the command given as arguments RUNS times and prints the mean time.
+bench() {
+	start=$(date +%s%N)
+	i=0
+	while [ $i -lt "$RUNS" ]; do
+		"$@" >/dev/null 2>&1
+		i=$((i + 1))
+	done
+	end=$(date +%s%N)
+	printf "%10d us  %s\n" $(((end - start) / RUNS / 1000)) "$*"
+}
+
+bench "$EXEC" --help
+bench "$EXEC" -d "$CONNINFO" list
+bench "$EXEC" -d "$CONNINFO" list a
+bench "$EXEC" -d "$CONNINFO" -f csv list
+
+# show is timed on the first engine listed, so it looks the engine up and
+# prints it rather than failing on its missing argument.
+engine=$("$EXEC" -d "$CONNINFO" -f tsv list 2>/dev/null | sed -n 2p | cut -f 1)
+if [ -n "$engine" ]; then
+	bench "$EXEC" -d "$CONNINFO" show "$engine"
+else
+	echo "No engines to show."
+fi
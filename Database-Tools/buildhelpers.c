@@ -0,0 +1,1261 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define _GNU_SOURCE // for getline and wait4
+#include "buildhelpers.h"
+#include "fmthelpers.h"
+#include "globals.h"
+#include "hashhelpers.h"
+#include "pkghelpers.h"
+#include "pqhelpers.h"
+#include "storehelpers.h"
+#include "vcshelpers.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <libpq-fe.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Compiling and linking a large C++ or Rust engine can take this much memory,
+// so no more jobs are run at once than there is memory for.
+#define BUILD_JOB_MEMORY (2LL << 30)
+// How long a build may run, in seconds, unless BUILD_TIMEOUT says otherwise.
+#define BUILD_DEFAULT_TIMEOUT 7200
+
+// The limits each of a number of builds running at once is held to, which
+// are recorded with each build.
+typedef struct {
+    long long memory;  // Bytes, for the whole build or each of its processes.
+    int       cpu_pct; // Percent of one core. Only a cgroup can enforce it.
+    int       timeout; // Seconds of wall time.
+} build_limits;
+
+// Shares the machine evenly between jobs builds, and reads the timeout from
+// BUILD_TIMEOUT.
+static build_limits buildLimits(int jobs) {
+    long         cores = sysconf(_SC_NPROCESSORS_ONLN);
+    build_limits limits;
+    limits.memory =
+        (long long)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE) / jobs;
+    limits.cpu_pct = (cores > 0 ? cores : 1) * 100 / jobs;
+    const char* timeout = getenv("BUILD_TIMEOUT");
+    limits.timeout = timeout ? atoi(timeout) : 0;
+    if (limits.timeout <= 0) {
+        limits.timeout = BUILD_DEFAULT_TIMEOUT;
+    }
+    return limits;
+}
+
+// Writes value to the file name in the directory dir.
+// Returns 0 on success, or -1 on failure.
+static int buildWriteFile(const char* dir, const char* name,
+                          const char* value) {
+    char path[4096];
+    snprintf(path, 4096, "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t written = write(fd, value, strlen(value));
+    close(fd);
+    return written == (ssize_t)strlen(value) ? 0 : -1;
+}
+
+// Creates a cgroup for the job under the cgroup v2 directory named by
+// BUILD_CGROUP, which must be delegated to this user, and applies limits to
+// it. Returns the path of the cgroup, or NULL if BUILD_CGROUP is not set or
+// the cgroup could not be made, in which case the build is held to limits
+// by setrlimit instead. Must be freed.
+static char* buildAllocCgroup(build_job* job, build_limits* limits) {
+    const char* root = getenv("BUILD_CGROUP");
+    if (root == NULL || root[0] == '\0') {
+        return NULL;
+    }
+    // The controllers may already be enabled, or be enabled by this write.
+    buildWriteFile(root, "cgroup.subtree_control", "+memory +cpu");
+
+    // The variants of a version may build at once, so each needs a cgroup of
+    // its own to keep its limits, and its kill, from reaching the others.
+    char* cgroup = errhandMalloc(strlen(root) + strlen(job->version_id) +
+                                 strlen(job->variant) + 32);
+    sprintf(cgroup, "%s/build-%d-%s-%s", root, (int)getpid(), job->version_id,
+            job->variant);
+    char memory[24];
+    char cpu[32];
+    snprintf(memory, 24, "%lld", limits->memory);
+    snprintf(cpu, 32, "%d 100000", limits->cpu_pct * 1000);
+    if ((mkdir(cgroup, 0777) == -1 && errno != EEXIST) ||
+        buildWriteFile(cgroup, "memory.max", memory) == -1 ||
+        buildWriteFile(cgroup, "memory.swap.max", "0") == -1 ||
+        buildWriteFile(cgroup, "cpu.max", cpu) == -1) {
+        perror(cgroup);
+        fprintf(stderr, "Falling back to setrlimit.\n");
+        rmdir(cgroup);
+        free(cgroup);
+        return NULL;
+    }
+    return cgroup;
+}
+
+// Does nothing, but interrupts wait4 so overdue builds can be killed.
+static void buildAlarm(int sig) {}
+
+// The SIGINT or SIGTERM received while builds were running, or 0. The
+// builds run in process groups of their own, so they would not receive it
+// and would outlive engine-db-cli unless killed.
+static volatile sig_atomic_t build_stop = 0;
+
+static void buildStop(int sig) {
+    build_stop = sig;
+}
+
+// Has SIGINT and SIGTERM set build_stop rather than end the process, saving
+// the previous actions to old, which must hold two.
+static void buildCatchStop(struct sigaction* old) {
+    struct sigaction stop_action = {0};
+    // Without SA_RESTART, the signal makes wait4 fail with EINTR.
+    stop_action.sa_handler = buildStop;
+    build_stop = 0;
+    sigaction(SIGINT, &stop_action, &old[0]);
+    sigaction(SIGTERM, &stop_action, &old[1]);
+}
+
+// Restores the actions buildCatchStop replaced, and if a signal was caught
+// meanwhile, raises it again now that every build has been killed and
+// recorded.
+static void buildReleaseStop(struct sigaction* old) {
+    sigaction(SIGINT, &old[0], NULL);
+    sigaction(SIGTERM, &old[1], NULL);
+    if (build_stop != 0) {
+        raise(build_stop);
+    }
+}
+
+// Kills the build of a job with everything it started.
+static void buildKill(build_job* job) {
+    // A process which left the process group is still in the cgroup.
+    if (job->cgroup != NULL) {
+        buildWriteFile(job->cgroup, "cgroup.kill", "1");
+    }
+    kill(-job->pid, SIGKILL);
+}
+
+// Kills every build among the count jobs which has run past the timeout, with
+// everything it started. Returns how many seconds until the next build is
+// due, which is at least 1.
+static int buildKillOverdue(build_job* jobs, int count, int timeout) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int next = timeout;
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].pid == 0 || jobs[i].timed_out) {
+            continue;
+        }
+        int left = jobs[i].started.tv_sec + timeout - now.tv_sec;
+        if (left > 0) {
+            next = left < next ? left : next;
+            continue;
+        }
+        jobs[i].timed_out = 1;
+        buildKill(&jobs[i]);
+    }
+    return next < 1 ? 1 : next;
+}
+
+// Waits with wait4 for pid (or any child, if pid is -1) to finish, killing
+// any of the count jobs which run past the timeout meanwhile, or all of them
+// once build_stop is set. Returns what wait4 returned.
+static pid_t buildWait(pid_t pid, build_job* jobs, int count, int timeout,
+                       int* status, struct rusage* usage) {
+    struct sigaction alarm_action = {0};
+    struct sigaction old_action;
+    // Without SA_RESTART, the alarm makes wait4 fail with EINTR.
+    alarm_action.sa_handler = buildAlarm;
+    sigaction(SIGALRM, &alarm_action, &old_action);
+    pid_t ret;
+    do {
+        if (build_stop != 0) {
+            for (int i = 0; i < count; i++) {
+                if (jobs[i].pid != 0) {
+                    buildKill(&jobs[i]);
+                }
+            }
+        }
+        alarm(buildKillOverdue(jobs, count, timeout));
+        ret = wait4(pid, status, 0, usage);
+        alarm(0);
+    } while (ret == -1 && errno == EINTR);
+    sigaction(SIGALRM, &old_action, NULL);
+    return ret;
+}
+
+static const char* const build_variants[BUILD_VARIANT_COUNT] = {
+    "generic", "native", "lto", "pgo"};
+
+// Finds each of the comma-separated variant names in list (see
+// pkg-run-makepkg.sh), and stores them in variants, which must hold
+// BUILD_VARIANT_COUNT names. A name given twice is stored once.
+// Returns the number of variants, or -1 if a name is not a variant.
+int buildParseVariants(const char* list, const char** variants) {
+    int count = 0;
+    while (1) {
+        size_t len = strcspn(list, ",");
+        int    i = 0;
+        while (i < BUILD_VARIANT_COUNT &&
+               (strlen(build_variants[i]) != len ||
+                strncmp(list, build_variants[i], len))) {
+            i++;
+        }
+        if (i == BUILD_VARIANT_COUNT) {
+            return -1;
+        }
+        int seen = 0;
+        for (int j = 0; j < count; j++) {
+            seen |= variants[j] == build_variants[i];
+        }
+        if (!seen) {
+            variants[count++] = build_variants[i];
+        }
+        if (list[len] == '\0') {
+            return count;
+        }
+        list += len + 1; // Move to the index after the comma.
+    }
+}
+
+// Returns how many builds may run at once: one per core, but no more than
+// one per BUILD_JOB_MEMORY of physical memory, and at least one.
+int buildJobLimit() {
+    long      cores = sysconf(_SC_NPROCESSORS_ONLN);
+    long long memory =
+        (long long)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+    long long limit = memory / BUILD_JOB_MEMORY;
+    if (cores > 0 && cores < limit) {
+        limit = cores;
+    }
+    return limit < 1 ? 1 : (int)limit;
+}
+
+// The source and PKGBUILD hash of each version are selected to find its
+// cache key.
+#define BUILD_SELECT                                                           \
+    "SELECT version_id, engine_name, version_name, source_uri, vcs_name, "     \
+    "frag_type, frag_val, encode(pkgbuild_hash, 'hex'), engine_id "            \
+    "FROM version "                                                            \
+    "JOIN engine USING (engine_id) LEFT JOIN revision USING (revision_id) "    \
+    "LEFT JOIN source USING (source_id) LEFT JOIN vcs USING (vcs_id) "         \
+    "WHERE pkgbuild_hash IS NOT NULL "
+// Versions of an engine are built oldest first, so that a persistent workspace
+// moves forward through its history.
+#define BUILD_ORDER " ORDER BY engine_name, release_date, version_name;"
+
+// Returns the versions with a stored PKGBUILD in set, which is "all",
+// "outdated" for those the last update scan found updates for, or otherwise
+// text to find in engine names. Must be cleared.
+static PGresult* buildAllocVersions(PGconn* conn, const char* set) {
+    if (!strcmp(set, "all")) {
+        return PQexec(conn, BUILD_SELECT BUILD_ORDER);
+    }
+    if (!strcmp(set, "outdated")) {
+        return PQexec(conn, BUILD_SELECT "AND revision_id IN "
+                                         "(SELECT revision_id FROM update)"
+                                         BUILD_ORDER);
+    }
+    const char* paramValues[1] = {set};
+    return PQexecParams(conn,
+                        BUILD_SELECT "AND strpos(lower(engine_name), "
+                                     "lower($1)) > 0" BUILD_ORDER,
+                        1, NULL, paramValues, NULL, NULL, 0);
+}
+
+// Writes the SHA-256 hash of what the toolchain reports its versions as, the
+// build script and the system's makepkg.conf to hex, so a new compiler, a
+// change to how builds are run or to the flags they start from invalidates
+// every cached build. The variant's own flags are hashed with the variant. It
+// is found once.
+static void buildToolchainId(char* hex) {
+    static char toolchain_hex[2 * HASH_SHA256_SIZE + 1];
+    if (toolchain_hex[0] == '\0') {
+        sha256_ctx ctx;
+        hashSha256Init(&ctx);
+        FILE* fp = popen("{ ${CC:-cc} --version; rustc --version; "
+                         "makepkg --version; cat ./pkg-run-makepkg.sh; "
+                         "cat /etc/makepkg.conf; } 2>/dev/null",
+                         "r");
+        if (fp != NULL) {
+            char   buf[4096];
+            size_t bytes;
+            while ((bytes = fread(buf, 1, sizeof(buf), fp)) > 0) {
+                hashSha256Update(&ctx, buf, bytes);
+            }
+            pclose(fp);
+        }
+        unsigned char digest[HASH_SHA256_SIZE];
+        hashSha256Final(&ctx, digest);
+        hashToHex(digest, HASH_SHA256_SIZE, toolchain_hex);
+    }
+    strcpy(hex, toolchain_hex);
+}
+
+// Writes an identifier of the downloads pkgbuild makes to source_id, which
+// must hold VCS_REVISION_ID_SIZE bytes: the hash of its first checksum array
+// of sha256sums, sha512sums or b2sums. Returns 0 on success, or -1 if it has
+// none or any of its sums are SKIP, so they do not pin what is downloaded.
+static int buildSourceSums(const char* pkgbuild, char* source_id) {
+    static const char* const arrays[] = {"sha256sums=(", "sha512sums=(",
+                                         "b2sums=("};
+    for (int i = 0; i < 3; i++) {
+        const char* start = pkgbuild;
+        size_t      len = strlen(arrays[i]);
+        // Only an assignment at the start of a line counts.
+        while ((start = strstr(start, arrays[i])) != NULL &&
+               start != pkgbuild && start[-1] != '\n') {
+            start += len;
+        }
+        if (start == NULL) {
+            continue;
+        }
+        const char* end = strchr(start, ')');
+        if (end == NULL) {
+            return -1;
+        }
+        size_t size = end - start + 1;
+        char*  sums = errhandMalloc(size + 1);
+        memcpy(sums, start, size);
+        sums[size] = '\0';
+        int pinned = strstr(sums, "SKIP") == NULL;
+        if (pinned) {
+            unsigned char digest[HASH_SHA256_SIZE];
+            hashSha256(sums, size, digest);
+            strcpy(source_id, "sums-");
+            hashToHex(digest, HASH_SHA256_SIZE / 2, source_id + 5);
+        }
+        free(sums);
+        return pinned ? 0 : -1;
+    }
+    return -1;
+}
+
+// Writes an identifier of the source of the version in row of res (see
+// BUILD_SELECT) as it is now to source_id, which must hold
+// VCS_REVISION_ID_SIZE bytes: the commit or revision it is at for git and
+// svn, or the checksums its PKGBUILD pins its downloads to otherwise.
+// Returns 0 on success, or -1 if the source could not be reached or is
+// downloaded unpinned, in which case no build of the version is taken from
+// the cache.
+static int buildSourceId(PGconn* conn, PGresult* res, int row,
+                         char* source_id) {
+    const char* vcs_name =
+        PQgetisnull(res, row, 4) ? "" : PQgetvalue(res, row, 4);
+    if (!PQgetisnull(res, row, 3) && (strncmp(vcs_name, "git", 3) == 0 ||
+                                      strncmp(vcs_name, "svn", 3) == 0)) {
+        revision rev = borrowRevision("", PQgetvalue(res, row, 5),
+                                      PQgetvalue(res, row, 6),
+                                      PQgetisnull(res, row, 6));
+        return vcsResolveRevision(&rev, PQgetvalue(res, row, 3), vcs_name,
+                                  source_id);
+    }
+    char* pkgbuild = pqAllocPkgbuild(conn, PQgetvalue(res, row, 0));
+    if (pkgbuild == NULL) {
+        return -1;
+    }
+    int ret = buildSourceSums(pkgbuild, source_id);
+    free(pkgbuild);
+    return ret;
+}
+
+// Writes the cache key of the variant of the version in row of res, whose
+// source is at source_id, to key: the hash of source_id, its PKGBUILD, the
+// toolchain and the variant. A build with the same key would produce the
+// same binary.
+static void buildCacheKey(PGresult* res, int row, const char* source_id,
+                          const char* variant, char* key) {
+    char toolchain_hex[2 * HASH_SHA256_SIZE + 1];
+    buildToolchainId(toolchain_hex);
+
+    sha256_ctx ctx;
+    hashSha256Init(&ctx);
+    hashSha256Update(&ctx, source_id, strlen(source_id));
+    hashSha256Update(&ctx, "\n", 1);
+    hashSha256Update(&ctx, PQgetvalue(res, row, 7),
+                     PQgetlength(res, row, 7));
+    hashSha256Update(&ctx, "\n", 1);
+    hashSha256Update(&ctx, toolchain_hex, 2 * HASH_SHA256_SIZE);
+    hashSha256Update(&ctx, "\n", 1);
+    hashSha256Update(&ctx, variant, strlen(variant));
+    unsigned char digest[HASH_SHA256_SIZE];
+    hashSha256Final(&ctx, digest);
+    hashToHex(digest, HASH_SHA256_SIZE, key);
+}
+
+// Finds the last successful build with cache key key whose binary is still
+// as it was built. Returns the path of the binary, or NULL if there is no
+// such build. Must be freed.
+static char* buildAllocCachedBinary(PGconn* conn, const char* key) {
+    const char* paramValues[1] = {key};
+
+    PGresult* res = PQexecParams(
+        conn,
+        "SELECT binary_path, encode(binary_sha256, 'hex') FROM build "
+        "WHERE cache_key = decode($1, 'hex') AND exit_status = 0 "
+        "AND binary_path IS NOT NULL ORDER BY build_id DESC LIMIT 1;",
+        1, NULL, paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return NULL;
+    }
+    char* binary = NULL;
+    if (PQntuples(res) == 1) {
+        // The binary may have been deleted or rebuilt by hand since.
+        unsigned char digest[HASH_SHA256_SIZE];
+        char          hex[2 * HASH_SHA256_SIZE + 1];
+        size_t        size;
+        if (hashSha256File(PQgetvalue(res, 0, 0), digest, &size) == 0) {
+            hashToHex(digest, HASH_SHA256_SIZE, hex);
+            if (!strcmp(hex, PQgetvalue(res, 0, 1))) {
+                binary = errhandStrdup(PQgetvalue(res, 0, 0));
+            }
+        }
+    }
+    PQclear(res);
+    return binary;
+}
+
+// Drops the cache keys of builds which can no longer be reused: failed
+// builds, builds whose binary is gone or has changed size, and builds
+// superseded by a later successful build with the same key.
+// Returns the number of keys dropped, or -1 on failure.
+static int buildCollectGarbage(PGconn* conn) {
+    PGresult* res = PQexec(conn, "SELECT build_id, binary_path, binary_size "
+                                 "FROM build WHERE cache_key IS NOT NULL "
+                                 "AND exit_status = 0;");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    // An array literal of the ids of builds whose binary is gone, e.g. {1,2}.
+    int   rows = PQntuples(res);
+    char* missing = errhandMalloc(12 * rows + 3);
+    int   len = sprintf(missing, "{");
+    for (int i = 0; i < rows; i++) {
+        struct stat st;
+        if (PQgetisnull(res, i, 1) ||
+            stat(PQgetvalue(res, i, 1), &st) == -1 || PQgetisnull(res, i, 2) ||
+            st.st_size != atoll(PQgetvalue(res, i, 2))) {
+            len += sprintf(missing + len, "%s%s", len > 1 ? "," : "",
+                           PQgetvalue(res, i, 0));
+        }
+    }
+    strcpy(missing + len, "}");
+    PQclear(res);
+
+    const char* paramValues[1] = {missing};
+    res = PQexecParams(
+        conn,
+        "UPDATE build b SET cache_key = NULL WHERE cache_key IS NOT NULL "
+        "AND (exit_status <> 0 OR build_id = ANY ($1::int[]) "
+        "OR EXISTS (SELECT 1 FROM build n WHERE n.cache_key = b.cache_key "
+        "AND n.exit_status = 0 AND n.build_id > b.build_id));",
+        1, NULL, paramValues, NULL, NULL, 0);
+    free(missing);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "UPDATE failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    int dropped = atoi(PQcmdTuples(res));
+    PQclear(res);
+    return dropped;
+}
+
+// Returns the id of a new build of the job's version, held to limits, with
+// its cache key (which may be empty, for a build which is never reused), or
+// -1 on failure.
+static int buildInsert(PGconn* conn, build_job* job, build_limits* limits) {
+    char memory_mb[24];
+    char cpu_pct[12];
+    char timeout[12];
+    snprintf(memory_mb, 24, "%lld", limits->memory >> 20);
+    snprintf(cpu_pct, 12, "%d", limits->cpu_pct);
+    snprintf(timeout, 12, "%d", limits->timeout);
+    const char* paramValues[7] = {job->version_id,
+                                  job->cache_key[0] ? job->cache_key : NULL,
+                                  memory_mb,
+                                  job->cgroup ? cpu_pct : NULL,
+                                  timeout,
+                                  job->cgroup ? "cgroup" : "rlimit",
+                                  job->variant};
+
+    PGresult* res = PQexecParams(
+        conn,
+        "INSERT INTO build (version_id, cache_key, mem_limit_mb, "
+        "cpu_limit_pct, time_limit_s, isolation, variant) "
+        "VALUES ($1, decode($2, 'hex'), $3, $4, $5, $6, $7) "
+        "RETURNING build_id;",
+        7, NULL, paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "INSERT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    int build_id = atoi(PQgetvalue(res, 0, 0));
+    PQclear(res);
+    return build_id;
+}
+
+// What pkg-run-makepkg.sh reports in the build-info file beside the PKGBUILD
+// it built, and what is measured of the build process.
+typedef struct {
+    int           exit_status;
+    long          wall_ms;
+    long          cpu_ms;
+    long          max_rss_kb;
+    char*         binary;
+    char*         compiler;
+    long long     binary_size;
+    unsigned char binary_sha256[HASH_SHA256_SIZE];
+    int           timed_out;
+    long long     bench_nps; // 0 if the binary has no bench command.
+} build_result;
+
+// Reads the build-info file in dir, which has a key=value pair on each line,
+// into result. A missing file leaves the binary and compiler NULL.
+static void buildReadInfo(const char* dir, build_result* result) {
+    char path[80];
+    snprintf(path, 80, "%s/build-info", dir);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return;
+    }
+    char*  line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, fp) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        char* value = strchr(line, '=');
+        if (value == NULL) {
+            continue;
+        }
+        *value = '\0';
+        value += 1; // Move to the index after the '='.
+        if (!strcmp(line, "binary") && result->binary == NULL) {
+            result->binary = errhandStrdup(value);
+        } else if (!strcmp(line, "compiler") && result->compiler == NULL) {
+            result->compiler = errhandStrdup(value);
+        } else if (!strcmp(line, "bench_nps")) {
+            result->bench_nps = atoll(value);
+        }
+    }
+    free(line);
+    fclose(fp);
+
+    size_t size;
+    if (result->binary != NULL &&
+        hashSha256File(result->binary, result->binary_sha256, &size) == 0) {
+        result->binary_size = size;
+    } else {
+        result->binary_size = -1;
+    }
+}
+
+// Moves each artifact listed in the build-info file in dir into the store,
+// recording it as an artifact of build_id.
+static void buildStoreArtifacts(PGconn* conn, int build_id, const char* dir) {
+    char path[80];
+    snprintf(path, 80, "%s/build-info", dir);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return;
+    }
+    char*  line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, fp) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        if (!strncmp(line, "artifact=", 9)) {
+            storeAddArtifact(conn, build_id, line + 9);
+        }
+    }
+    free(line);
+    fclose(fp);
+}
+
+// Records result as the outcome of build_id. Measurements which are not
+// known are stored as NULL. Returns 0 on success, or -1 on failure.
+static int buildFinish(PGconn* conn, int build_id, build_result* result) {
+    char build_id_str[12];
+    char exit_status_str[12];
+    char wall_ms_str[24];
+    char cpu_ms_str[24];
+    char max_rss_str[24];
+    char binary_size_str[24];
+    char sha256_hex[2 * HASH_SHA256_SIZE + 1];
+    char bench_nps_str[24];
+    snprintf(build_id_str, 12, "%d", build_id);
+    snprintf(exit_status_str, 12, "%d", result->exit_status);
+    snprintf(wall_ms_str, 24, "%ld", result->wall_ms);
+    snprintf(cpu_ms_str, 24, "%ld", result->cpu_ms);
+    snprintf(max_rss_str, 24, "%ld", result->max_rss_kb);
+    snprintf(binary_size_str, 24, "%lld", result->binary_size);
+    snprintf(bench_nps_str, 24, "%lld", result->bench_nps);
+    hashToHex(result->binary_sha256, HASH_SHA256_SIZE, sha256_hex);
+    int         has_binary = result->binary_size != -1;
+    const char* paramValues[11] = {
+        build_id_str,
+        exit_status_str,
+        result->wall_ms >= 0 ? wall_ms_str : NULL,
+        result->cpu_ms >= 0 ? cpu_ms_str : NULL,
+        result->max_rss_kb >= 0 ? max_rss_str : NULL,
+        has_binary ? binary_size_str : NULL,
+        has_binary ? sha256_hex : NULL,
+        result->compiler,
+        has_binary ? result->binary : NULL,
+        result->timed_out ? "true" : "false",
+        result->bench_nps > 0 ? bench_nps_str : NULL};
+
+    PGresult* res = PQexecParams(
+        conn,
+        "UPDATE build SET finished_at = now(), exit_status = $2, "
+        "wall_ms = $3, cpu_ms = $4, max_rss_kb = $5, binary_size = $6, "
+        "binary_sha256 = decode($7, 'hex'), compiler = $8, "
+        "binary_path = $9, timed_out = $10, bench_nps = $11 "
+        "WHERE build_id = $1;",
+        11, NULL, paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "UPDATE failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+    return 0;
+}
+
+// Returns the URI of the source of version_id if it is in git, or NULL if it
+// is not or has no source. Must be freed.
+static char* buildAllocGitSource(PGconn* conn, const char* version_id) {
+    const char* paramValues[1] = {version_id};
+
+    PGresult* res = PQexecParams(
+        conn,
+        "SELECT source_uri FROM version JOIN revision USING (revision_id) "
+        "JOIN source USING (source_id) JOIN vcs USING (vcs_id) "
+        "WHERE version_id = $1 AND vcs_name = 'git';",
+        1, NULL, paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return NULL;
+    }
+    char* uri = PQntuples(res) ? errhandStrdup(PQgetvalue(res, 0, 0)) : NULL;
+    PQclear(res);
+    return uri;
+}
+
+// Makes git, as run by makepkg in this process, clone the repository at uri
+// from the mirror the update scan keeps of it, if there is one, so the
+// sources are not downloaded again. insteadOf rewrites every URL starting
+// with the given one, so the rewrite is only made for uri ending in .git, as
+// pkgCreateDefaultFile spells it. Without the suffix, the URL of any other
+// repository whose name starts with the engine's, such as engine-nnue, would
+// be rewritten too. A PKGBUILD spelling uri without .git clones it as usual.
+static void buildUseMirror(const char* uri) {
+    char path[VCS_MIRROR_PATH_SIZE];
+    vcsMirrorPath(uri, path);
+    char* mirror = realpath(path, NULL);
+    if (mirror == NULL) {
+        return;
+    }
+    int len = strlen(uri);
+    while (len > 0 && uri[len - 1] == '/') {
+        len--;
+    }
+    if (len >= 4 && !strncmp(uri + len - 4, ".git", 4)) {
+        len -= 4;
+    }
+    char* key = errhandMalloc(strlen(mirror) + 16);
+    char* value = errhandMalloc(len + 5);
+    sprintf(key, "url.%s.insteadOf", mirror);
+    sprintf(value, "%.*s.git", len, uri);
+    setenv("GIT_CONFIG_COUNT", "1", 1);
+    setenv("GIT_CONFIG_KEY_0", key, 1);
+    setenv("GIT_CONFIG_VALUE_0", value, 1);
+    free(key);
+    free(value);
+    free(mirror);
+}
+
+// Makes pkg-run-makepkg.sh, as run by this process, keep its workspace for
+// the next build, and share a compiler cache under BUILD_WORKSPACE_ROOT with
+// every other build, unless CCACHE_DIR already names one.
+static void buildUseWorkspace() {
+    setenv("KEEP_WORKSPACE", "1", 1);
+    char* root = realpath(BUILD_WORKSPACE_ROOT, NULL);
+    if (root != NULL) {
+        char* ccache = errhandMalloc(strlen(root) + 8);
+        sprintf(ccache, "%s/ccache", root);
+        setenv("CCACHE_DIR", ccache, 0);
+        free(ccache);
+        free(root);
+    }
+}
+
+// Records the outcome of a job which failed before its build could start.
+static void buildAbandon(PGconn* conn, build_job* job) {
+    build_result result = {-1, -1, -1, -1, NULL, NULL, -1};
+    buildFinish(conn, job->build_id, &result);
+    if (job->cgroup != NULL) {
+        rmdir(job->cgroup);
+        free(job->cgroup);
+        job->cgroup = NULL;
+    }
+}
+
+// Holds the calling process to limits with setrlimit, for when there is no
+// cgroup. Memory can only be limited for each process rather than the whole
+// build, and the CPU share not at all. The CPU time of each process is capped
+// at what its share could use before the timeout, which stops a build even if
+// nothing is left to enforce the timeout.
+static void buildLimitProcess(build_limits* limits) {
+    int           cores = (limits->cpu_pct + 99) / 100;
+    rlim_t        cpu_s = (rlim_t)limits->timeout * (cores > 0 ? cores : 1);
+    struct rlimit data = {limits->memory, limits->memory};
+    struct rlimit core = {0, 0};
+    // SIGXCPU comes at the soft limit, and SIGKILL at the hard one.
+    struct rlimit cpu = {cpu_s, cpu_s + 10};
+    setrlimit(RLIMIT_DATA, &data);
+    setrlimit(RLIMIT_CORE, &core);
+    setrlimit(RLIMIT_CPU, &cpu);
+}
+
+// Records a build of the job's version and starts pkg-run-makepkg.sh on the
+// PKGBUILD in job->dir in a child process, building in workspace under
+// limits. The build runs in its own process group (and cgroup, if there is
+// one), so all of it can be killed at once. If log_path is not NULL, all
+// output goes there rather than to the terminal, which is otherwise handed to
+// the build until it finishes. Returns 0 on success, or -1 on failure.
+static int buildSpawn(PGconn* conn, build_job* job, const char* workspace,
+                      const char* log_path, build_limits* limits) {
+    char pkgbuild_path[80];
+    char info_path[80];
+    snprintf(pkgbuild_path, 80, "%s/PKGBUILD", job->dir);
+    snprintf(info_path, 80, "%s/build-info", job->dir);
+    // A failed build must not be credited with the last one's binary.
+    remove(info_path);
+
+    job->timed_out = 0;
+    job->cgroup = buildAllocCgroup(job, limits);
+    job->build_id = buildInsert(conn, job, limits);
+    if (job->build_id == -1) {
+        if (job->cgroup != NULL) {
+            rmdir(job->cgroup);
+            free(job->cgroup);
+            job->cgroup = NULL;
+        }
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    int foreground = log_path == NULL && isatty(STDIN_FILENO);
+
+    // Anything buffered would otherwise be written by both processes.
+    fflush(NULL);
+    job->pid = fork();
+    if (job->pid == -1) {
+        perror("fork");
+        buildAbandon(conn, job);
+        return -1;
+    }
+    if (job->pid == 0) {
+        setpgid(0, 0);
+        if (foreground) {
+            signal(SIGTTOU, SIG_IGN);
+            tcsetpgrp(STDIN_FILENO, getpid());
+            signal(SIGTTOU, SIG_DFL);
+        }
+        if (job->cgroup == NULL ||
+            buildWriteFile(job->cgroup, "cgroup.procs", "0") == -1) {
+            buildLimitProcess(limits);
+        }
+        if (log_path != NULL) {
+            int log = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            int null = open("/dev/null", O_RDONLY);
+            if (log != -1) {
+                dup2(log, STDOUT_FILENO);
+                dup2(log, STDERR_FILENO);
+                close(log);
+            }
+            if (null != -1) {
+                dup2(null, STDIN_FILENO);
+                close(null);
+            }
+        }
+        if (job->source_uri != NULL) {
+            buildUseMirror(job->source_uri);
+        }
+        if (job->incremental) {
+            buildUseWorkspace();
+        }
+        if (job->defer_bench) {
+            setenv("DEFER_BENCH", "1", 1);
+        }
+        execl("./pkg-run-makepkg.sh", "pkg-run-makepkg.sh", pkgbuild_path,
+              workspace, ".", job->variant, (char*)NULL);
+        perror("./pkg-run-makepkg.sh");
+        _exit(127);
+    }
+    // Whichever of the two runs first sets the group, so neither races.
+    setpgid(job->pid, job->pid);
+    if (foreground) {
+        signal(SIGTTOU, SIG_IGN);
+        tcsetpgrp(STDIN_FILENO, job->pid);
+        signal(SIGTTOU, SIG_DFL);
+    }
+    return 0;
+}
+
+// Measures and records the outcome of a job whose process has been waited
+// for with wait4, which gave status and usage. Returns the exit status of
+// the build, which is the signal which killed it negated if it was killed.
+static int buildCollect(PGconn* conn, build_job* job, int status,
+                        struct rusage* usage) {
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    build_result result = {0};
+    result.exit_status =
+        WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+    result.wall_ms = (finished.tv_sec - job->started.tv_sec) * 1000 +
+                     (finished.tv_nsec - job->started.tv_nsec) / 1000000;
+    // The usage of the script includes every process it waited for, such as
+    // the compiler, and ru_maxrss is the largest of them.
+    result.cpu_ms = (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1000 +
+                    (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) / 1000;
+    result.max_rss_kb = usage->ru_maxrss;
+    result.timed_out = job->timed_out;
+    if (job->cgroup != NULL) {
+        rmdir(job->cgroup);
+        free(job->cgroup);
+        job->cgroup = NULL;
+    }
+    if (result.exit_status == 0) {
+        buildReadInfo(job->dir, &result);
+    } else {
+        result.binary_size = -1;
+    }
+
+    buildFinish(conn, job->build_id, &result);
+    if (result.exit_status == 0) {
+        buildStoreArtifacts(conn, job->build_id, job->dir);
+    }
+    free(result.binary);
+    free(result.compiler);
+    return result.exit_status;
+}
+
+// Returns whether one of the count jobs is running in the persistent
+// workspace of engine_id's builds of variant.
+static int buildWorkspaceBusy(build_job* jobs, int count,
+                              const char* engine_id, const char* variant) {
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].pid != 0 && jobs[i].variant == variant &&
+            !strcmp(jobs[i].engine_id, engine_id)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Writes the PKGBUILD of the job's version into its own directory under
+// BUILD_ROOT, and starts building it there, with all output going to
+// build.log. The workspace is in that directory, or if job->incremental is
+// set, is the engine's persistent workspace for the variant under
+// BUILD_WORKSPACE_ROOT. Returns 0 on success, or -1 on failure.
+static int buildStartJob(PGconn* conn, build_job* job,
+                         build_limits* limits) {
+    char workspace[80];
+    char log_path[80];
+    char pkgbuild_path[80];
+    snprintf(job->dir, sizeof(job->dir), BUILD_ROOT "/%s-%s", job->version_id,
+             job->variant);
+    if (job->incremental) {
+        snprintf(workspace, 80, BUILD_WORKSPACE_ROOT "/engine-%s-%s",
+                 job->engine_id, job->variant);
+    } else {
+        snprintf(workspace, 80, "%s/build", job->dir);
+    }
+    snprintf(log_path, 80, "%s/build.log", job->dir);
+    snprintf(pkgbuild_path, 80, "%s/PKGBUILD", job->dir);
+
+    if (mkdir(job->dir, 0777) == -1 && errno != EEXIST) {
+        perror(job->dir);
+        return -1;
+    }
+    char* pkgbuild = pqAllocPkgbuild(conn, (char*)job->version_id);
+    if (pkgbuild == NULL) {
+        return -1;
+    }
+    size_t bytes = pkgStoreStringToPath(pkgbuild, pkgbuild_path);
+    free(pkgbuild);
+    if (bytes == 0) {
+        return -1;
+    }
+    return buildSpawn(conn, job, workspace, log_path, limits);
+}
+
+// Runs the bench command of the binary of each of the count builds in
+// build_ids, one at a time and outside of any build's limits, and records the
+// nodes per second each reports. The farm leaves this until every build has
+// finished, since a binary measured beside other builds under a share of the
+// CPU would measure the load rather than the variant.
+static void buildBenchmark(PGconn* conn, const int* build_ids, int count) {
+    fmtStatus("Benchmarking %d builds.\n", count);
+    mkdir(BUILD_ROOT "/bench", 0777);
+    for (int i = 0; i < count && build_stop == 0; i++) {
+        char        id[16];
+        const char* paramValues[2] = {id, NULL};
+        snprintf(id, 16, "%d", build_ids[i]);
+        PGresult* res = PQexecParams(
+            conn,
+            "SELECT binary_path FROM build WHERE build_id = $1 "
+            "AND binary_path IS NOT NULL;",
+            1, NULL, paramValues, NULL, NULL, 0);
+        if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != 1) {
+            PQclear(res);
+            continue;
+        }
+        // The path is single-quoted for the shell, with any single quote in
+        // it closing the quotes, escaped, and opening them again.
+        const char* path = PQgetvalue(res, 0, 0);
+        char*       cmd = errhandMalloc(4 * strlen(path) + 160);
+        char*       out = cmd;
+        out += sprintf(out, "cd " BUILD_ROOT "/bench && timeout 600 '");
+        for (const char* c = path; *c != '\0'; c++) {
+            if (*c == '\'') {
+                out += sprintf(out, "'\\''");
+            } else {
+                *out++ = *c;
+            }
+        }
+        sprintf(out, "' bench 2>&1 </dev/null | grep -iE 'nodes/second|nps' "
+                     "| grep -oE '[0-9]+' | tail -n 1");
+        PQclear(res);
+
+        char  nps[24] = "";
+        FILE* fp = popen(cmd, "r");
+        free(cmd);
+        if (fp == NULL) {
+            continue;
+        }
+        if (fgets(nps, sizeof(nps), fp) != NULL) {
+            nps[strcspn(nps, "\n")] = '\0';
+        }
+        pclose(fp);
+        if (atoll(nps) <= 0) {
+            continue;
+        }
+        paramValues[1] = nps;
+        res = PQexecParams(
+            conn, "UPDATE build SET bench_nps = $2 WHERE build_id = $1;", 2,
+            NULL, paramValues, NULL, NULL, 0);
+        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+            fprintf(stderr, "UPDATE failed: %s", PQerrorMessage(conn));
+        }
+        PQclear(res);
+    }
+}
+
+// Builds variant (or generic, if it is NULL) of ./PKGBUILD as version_id in
+// ./build, with output going to the terminal, and records the outcome like
+// the builds of the farm. The PKGBUILD may have been edited, so the build is
+// never taken from the cache.
+// Returns the exit status of the build, or -1 if it could not be started.
+int buildVersion(PGconn* conn, char* version_id, const char* variant) {
+    const char* variants[BUILD_VARIANT_COUNT];
+    if (buildParseVariants(variant ? variant : "generic", variants) != 1) {
+        fprintf(stderr, "A variant of generic, native, lto or pgo expected.\n");
+        return -1;
+    }
+    build_limits limits = buildLimits(1);
+    char*        source_uri = buildAllocGitSource(conn, version_id);
+    build_job    job = {0};
+    job.version_id = version_id;
+    job.source_uri = source_uri;
+    job.variant = variants[0];
+    strcpy(job.dir, ".");
+    struct sigaction old_actions[2];
+    buildCatchStop(old_actions);
+    int spawned = buildSpawn(conn, &job, "build", NULL, &limits);
+    free(source_uri);
+    if (spawned == -1) {
+        buildReleaseStop(old_actions);
+        return -1;
+    }
+    int           status;
+    struct rusage usage;
+    pid_t waited = buildWait(job.pid, &job, 1, limits.timeout, &status, &usage);
+    // Take the terminal back from the build.
+    if (isatty(STDIN_FILENO)) {
+        signal(SIGTTOU, SIG_IGN);
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+        signal(SIGTTOU, SIG_DFL);
+    }
+    if (waited == -1) {
+        perror("wait4");
+        buildAbandon(conn, &job);
+        buildReleaseStop(old_actions);
+        return -1;
+    }
+    if (job.timed_out) {
+        fprintf(stderr, "The build was killed after %d seconds.\n",
+                limits.timeout);
+    }
+    int exit_status = buildCollect(conn, &job, status, &usage);
+    buildReleaseStop(old_actions);
+    return exit_status;
+}
+
+// Builds each of the comma-separated variant_list (or generic, if it is NULL)
+// of every version in set (see buildAllocVersions), running up to
+// buildJobLimit builds at once, each held to an even share of the machine
+// and killed if it runs past the timeout, and records the outcome of each in
+// the build table. A version whose cache key matches an earlier successful
+// build with its binary intact is not built again. Returns the number of
+// builds which failed, or -1 if none could be attempted.
+int buildVersions(PGconn* conn, const char* set, const char* variant_list) {
+    const char* variants[BUILD_VARIANT_COUNT];
+    int         variant_count =
+        buildParseVariants(variant_list ? variant_list : "generic", variants);
+    if (variant_count == -1) {
+        fprintf(stderr, "Variants of generic, native, lto or pgo expected.\n");
+        return -1;
+    }
+    PGresult* res = buildAllocVersions(conn, set);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        if (!strcmp(set, "outdated")) {
+            fprintf(stderr, "Outdated versions are known after a scan.\n");
+        }
+        PQclear(res);
+        return -1;
+    }
+    int total = PQntuples(res) * variant_count;
+    if (total == 0) {
+        fprintf(stderr, "No versions with a stored PKGBUILD match %s.\n", set);
+        PQclear(res);
+        return -1;
+    }
+    if (mkdir(BUILD_ROOT, 0777) == -1 && errno != EEXIST) {
+        perror(BUILD_ROOT);
+        PQclear(res);
+        return -1;
+    }
+
+    int dropped = buildCollectGarbage(conn);
+    if (dropped > 0) {
+        fmtStatus("%d stale cache entries dropped.\n", dropped);
+    }
+
+    int limit = buildJobLimit();
+    if (limit > total) {
+        limit = total;
+    }
+    build_limits limits = buildLimits(limit);
+    const char*  incremental_env = getenv("BUILD_INCREMENTAL");
+    int          incremental =
+        incremental_env != NULL && incremental_env[0] != '\0';
+    if (incremental && mkdir(BUILD_WORKSPACE_ROOT, 0777) == -1 &&
+        errno != EEXIST) {
+        perror(BUILD_WORKSPACE_ROOT);
+        incremental = 0;
+    }
+    fmtStatus("Building %d versions, %d at a time, each with %lld MiB of "
+              "memory for up to %d seconds.\n",
+              total, limit, limits.memory >> 20, limits.timeout);
+    build_job* jobs = errhandCalloc(limit, sizeof(build_job));
+    // begun marks the builds which were started or taken from the cache,
+    // and first is the first which was not.
+    char* begun = errhandCalloc(total, 1);
+    int   first = 0;
+    int   running = 0;
+    int   done = 0;
+    int   failed = 0;
+    int   cached = 0;
+    // The revision the source of each version is at is found once, for its
+    // first variant, and is known if source_found is 1 for the version.
+    int   rows = total / variant_count;
+    char* source_found = errhandCalloc(rows, 1);
+    char* source_ids = errhandMalloc((size_t)rows * VCS_REVISION_ID_SIZE);
+    // The builds which succeeded, to be benchmarked once all have finished.
+    int* built = errhandMalloc(total * sizeof(int));
+    int  built_count = 0;
+    // Once interrupted, no more builds are started, and those running are
+    // killed and recorded before the signal is raised again.
+    struct sigaction old_actions[2];
+    buildCatchStop(old_actions);
+    while (done < total && !(build_stop != 0 && running == 0)) {
+        // Fill every free slot before waiting for a build to finish.
+        for (int slot = 0; slot < limit && first < total && build_stop == 0;
+             slot++) {
+            if (jobs[slot].pid != 0) {
+                continue;
+            }
+            // Builds sharing a persistent workspace wait for each other.
+            int next = first;
+            while (next < total &&
+                   (begun[next] ||
+                    (incremental &&
+                     buildWorkspaceBusy(
+                         jobs, limit, PQgetvalue(res, next / variant_count, 8),
+                         variants[next % variant_count])))) {
+                next++;
+            }
+            if (next == total) {
+                break;
+            }
+            begun[next] = 1;
+            while (first < total && begun[first]) {
+                first++;
+            }
+
+            build_job* job = &jobs[slot];
+            int        row = next / variant_count;
+            char*      source_id = source_ids + row * VCS_REVISION_ID_SIZE;
+            job->version_id = PQgetvalue(res, row, 0);
+            job->engine_name = PQgetvalue(res, row, 1);
+            job->version_name = PQgetvalue(res, row, 2);
+            job->source_uri = PQgetisnull(res, row, 4) ||
+                                      strcmp(PQgetvalue(res, row, 4), "git")
+                                  ? NULL
+                                  : PQgetvalue(res, row, 3);
+            job->engine_id = PQgetvalue(res, row, 8);
+            job->variant = variants[next % variant_count];
+            job->incremental = incremental;
+            job->defer_bench = 1;
+            if (source_found[row] == 0) {
+                source_found[row] =
+                    buildSourceId(conn, res, row, source_id) == 0 ? 1 : -1;
+            }
+            if (source_found[row] == 1) {
+                buildCacheKey(res, row, source_id, job->variant,
+                              job->cache_key);
+            } else {
+                job->cache_key[0] = '\0';
+            }
+            char* binary = job->cache_key[0]
+                               ? buildAllocCachedBinary(conn, job->cache_key)
+                               : NULL;
+            if (binary != NULL) {
+                done += 1;
+                cached += 1;
+                fmtStatus("[%d/%d] %s %s %s is up to date (%s).\n", done,
+                          total, job->engine_name, job->version_name,
+                          job->variant, binary);
+                free(binary);
+                continue;
+            }
+            if (buildStartJob(conn, job, &limits) == -1) {
+                job->pid = 0;
+                done += 1;
+                failed += 1;
+                fmtStatus("[%d/%d] %s %s %s could not be started.\n", done,
+                          total, job->engine_name, job->version_name,
+                          job->variant);
+                continue;
+            }
+            running += 1;
+        }
+        if (running == 0) {
+            continue;
+        }
+
+        int           status;
+        struct rusage usage;
+        pid_t         pid =
+            buildWait(-1, jobs, limit, limits.timeout, &status, &usage);
+        if (pid == -1) {
+            perror("wait4");
+            break;
+        }
+        build_job* job = NULL;
+        for (int slot = 0; slot < limit; slot++) {
+            if (jobs[slot].pid == pid) {
+                job = &jobs[slot];
+            }
+        }
+        if (job == NULL) {
+            continue;
+        }
+        int exit_status = buildCollect(conn, job, status, &usage);
+        job->pid = 0;
+        running -= 1;
+        done += 1;
+        if (exit_status != 0) {
+            failed += 1;
+        } else {
+            built[built_count++] = job->build_id;
+        }
+        fmtStatus("[%d/%d] %s %s %s %s (see %s/build.log).\n", done, total,
+                  job->engine_name, job->version_name, job->variant,
+                  exit_status == 0  ? "built"
+                  : job->timed_out ? "timed out"
+                  : build_stop     ? "interrupted"
+                                   : "failed",
+                  job->dir);
+    }
+    if (build_stop == 0 && built_count > 0) {
+        buildBenchmark(conn, built, built_count);
+    }
+
+    free(jobs);
+    free(begun);
+    free(source_found);
+    free(source_ids);
+    free(built);
+    PQclear(res);
+    fmtStatus("%d of %d builds succeeded, %d from the cache.\n",
+              total - failed, total, cached);
+    buildReleaseStop(old_actions);
+    return failed;
+}
+
+// Lists the most recent builds of version_id and their measurements, so
+// regressions in build time or binary size stand out.
+void buildListBuilds(PGconn* conn, char* version_id) {
+    const char* paramValues[1] = {version_id};
+
+    PGresult* res = PQexecParams(
+        conn,
+        "SELECT started_at, variant, exit_status, timed_out, bench_nps, "
+        "wall_ms, cpu_ms, max_rss_kb, binary_size, "
+        "encode(binary_sha256, 'hex') AS binary_sha256, compiler, "
+        "isolation, mem_limit_mb, cpu_limit_pct, time_limit_s "
+        "FROM build WHERE version_id = $1 "
+        "ORDER BY started_at DESC LIMIT 10;",
+        1, NULL, paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return;
+    }
+    pqPrintTable(res);
+    PQclear(res);
+}
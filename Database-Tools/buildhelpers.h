@@ -0,0 +1,66 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef BUILDHELPERS_H
+#define BUILDHELPERS_H
+
+#include <libpq-fe.h>
+#include <sys/types.h>
+#include <time.h>
+
+// The directory holding a directory per version built by the farm, with its
+// PKGBUILD, workspace and build log.
+#define BUILD_ROOT "builds"
+// The directory holding the persistent workspace of each engine and variant
+// built with BUILD_INCREMENTAL set, and the compiler cache they share.
+#define BUILD_WORKSPACE_ROOT "workspaces"
+// generic, native, lto and pgo, the sets of compiler flags an engine can be
+// built with (see pkg-run-makepkg.sh).
+#define BUILD_VARIANT_COUNT 4
+
+// A build of a variant of a version running in a child process. engine_id,
+// engine_name, version_name and source_uri (which is NULL unless the source
+// is in git) point into the result the version was selected from. dir holds the
+// PKGBUILD being built, and is where the build reports what it produced.
+// cache_key is the hex of the build's cache key, or empty if it has none.
+// cgroup is the path of the cgroup the build runs in, or NULL if it is held
+// to its limits by setrlimit.
+typedef struct {
+    pid_t           pid;
+    int             build_id;
+    const char*     version_id;
+    const char*     engine_id;
+    const char*     engine_name;
+    const char*     version_name;
+    const char*     source_uri;
+    const char*     variant;
+    int             incremental; // Is the workspace kept for the next build?
+    int             defer_bench; // Is the binary benchmarked by the caller?
+    char            dir[64];
+    char            cache_key[65];
+    char*           cgroup;
+    int             timed_out;
+    struct timespec started;
+} build_job;
+
+extern int  buildParseVariants(const char* list, const char** variants);
+extern int  buildJobLimit();
+extern int  buildVersion(PGconn* conn, char* version_id, const char* variant);
+extern int  buildVersions(PGconn* conn, const char* set,
+                          const char* variant_list);
+extern void buildListBuilds(PGconn* conn, char* version_id);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "cachehelpers.h"
+#include "globals.h"
+#include <libpq-fe.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The channel the triggers in Create-Tables.sql notify whenever a table
+// which cached queries read from is modified.
+#define CACHE_CHANNEL "engine_db_cache"
+
+// The cache is direct-mapped: each key can only be stored in the slot its
+// hash selects, and replaces whatever was there.
+#define CACHE_SLOTS 256
+
+typedef struct {
+    char*     key;
+    size_t    key_len;
+    PGresult* res;
+} cache_entry;
+
+static cache_entry entries[CACHE_SLOTS];
+static int         enabled = 0;
+
+// Starts caching results. Every cached result is dropped as soon as another
+// session (or this one) modifies a table, which the server reports through
+// NOTIFY on CACHE_CHANNEL. Returns 0 on success, or -1 on failure.
+int cacheEnable(PGconn* conn) {
+    PGresult* res = PQexec(conn, "LISTEN " CACHE_CHANNEL ";");
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "LISTEN failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+    enabled = 1;
+    return 0;
+}
+
+// Stops caching results and drops everything cached.
+// Returns 0 on success, or -1 on failure.
+int cacheDisable(PGconn* conn) {
+    enabled = 0;
+    cacheFlush();
+    PGresult* res = PQexec(conn, "UNLISTEN " CACHE_CHANNEL ";");
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "UNLISTEN failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+    return 0;
+}
+
+int cacheIsEnabled() { return enabled; }
+
+void cacheFlush() {
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        free(entries[i].key);
+        PQclear(entries[i].res);
+        entries[i].key = NULL;
+        entries[i].res = NULL;
+    }
+}
+
+// Reads any notifications which have arrived without blocking. Since any
+// change may affect any cached query, a single notification drops everything.
+static void cachePollNotifications(PGconn* conn) {
+    PGnotify* notify;
+    int       changed = 0;
+    PQconsumeInput(conn);
+    while ((notify = PQnotifies(conn)) != NULL) {
+        changed = 1;
+        PQfreemem(notify);
+    }
+    if (changed) {
+        cacheFlush();
+    }
+}
+
+// The key is the command followed by each parameter, each terminated by a
+// NUL. A NULL parameter is written as a lone 0xff byte, which cannot occur in
+// text sent to the server, so it differs from every string.
+// This function allocates a char*, which needs to be freed when done.
+static char* cacheAllocKey(const char* command, int nParams,
+                           const char* const* paramValues, size_t* key_len) {
+    size_t len = strlen(command) + 1;
+    for (int i = 0; i < nParams; i++) {
+        len += paramValues[i] ? strlen(paramValues[i]) + 1 : 2;
+    }
+    char* key = errhandMalloc(len);
+    char* end = key;
+    for (int i = -1; i < nParams; i++) {
+        const char* part = i == -1 ? command : paramValues[i];
+        if (part == NULL) {
+            part = "\xff";
+        }
+        size_t part_len = strlen(part) + 1;
+        memcpy(end, part, part_len);
+        end += part_len;
+    }
+    *key_len = len;
+    return key;
+}
+
+// 64-bit FNV-1a.
+static uint64_t cacheHash(const char* key, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+// Behaves as PQexecParams with text parameters and text results. While the
+// cache is enabled, successful results are kept, and a repeat of the same
+// command with the same parameters is answered with a copy of the kept result
+// without contacting the server. The returned result must be cleared.
+PGresult* cacheExecParams(PGconn* conn, const char* command, int nParams,
+                          const char* const* paramValues) {
+    if (!enabled) {
+        return PQexecParams(conn, command, nParams, NULL, paramValues, NULL,
+                            NULL, 0);
+    }
+    cachePollNotifications(conn);
+
+    size_t       key_len;
+    char*        key = cacheAllocKey(command, nParams, paramValues, &key_len);
+    cache_entry* entry = &entries[cacheHash(key, key_len) % CACHE_SLOTS];
+    if (entry->key != NULL && entry->key_len == key_len &&
+        !memcmp(entry->key, key, key_len)) {
+        free(key);
+        return PQcopyResult(entry->res, PG_COPYRES_ATTRS | PG_COPYRES_TUPLES);
+    }
+
+    PGresult* res =
+        PQexecParams(conn, command, nParams, NULL, paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        free(key);
+        return res;
+    }
+    free(entry->key);
+    PQclear(entry->res);
+    entry->key = key;
+    entry->key_len = key_len;
+    entry->res = PQcopyResult(res, PG_COPYRES_ATTRS | PG_COPYRES_TUPLES);
+    if (entry->res == NULL) {
+        free(entry->key);
+        entry->key = NULL;
+    }
+    return res;
+}
@@ -0,0 +1,30 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef CACHEHELPERS_H
+#define CACHEHELPERS_H
+
+#include <libpq-fe.h>
+
+extern int  cacheEnable(PGconn* conn);
+extern int  cacheDisable(PGconn* conn);
+extern int  cacheIsEnabled();
+extern void cacheFlush();
+
+extern PGresult* cacheExecParams(PGconn* conn, const char* command,
+                                 int nParams, const char* const* paramValues);
+
+#endif
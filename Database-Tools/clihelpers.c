@@ -15,15 +15,47 @@ limitations under the License.
 */
 
 #include "clihelpers.h"
+#include "buildhelpers.h"
+#include "cachehelpers.h"
+#include "fmthelpers.h"
 #include "globals.h"
-#include "pkghelpers.h"
+#include "graphhelpers.h"
+#include "iohelpers.h"
 #include "pqhelpers.h"
+#include "srchelpers.h"
+#include "storehelpers.h"
+#include "triehelpers.h"
 #include "vcshelpers.h"
 #include <ctype.h> //for toupper
 #include <libpq-fe.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#ifdef HAVE_READLINE
+#include <readline/history.h>
+#include <readline/readline.h>
+#endif
+
+// What the next line read by cliReadLine may be completed to. In a menu
+// ('R'oot or 'E'ngine), the argument of a command is completed according to
+// the command's letter. At a prompt (menu 0), the whole line is a name of
+// kind, or nothing is completed if kind is -1. Reset after every line.
+typedef struct {
+    PGconn*     conn;
+    char        menu;
+    int         kind;
+    const char* engine_id;
+} cli_completion;
+
+static cli_completion completion = {NULL, 0, -1, NULL};
+
+// Sets what the next line read by cliReadLine is completed against.
+static void cliSetCompletion(char menu, int kind, const char* engine_id) {
+    completion.menu = menu;
+    completion.kind = kind;
+    completion.engine_id = engine_id;
+}
 
 void cliRootLoop(PGconn* conn) {
     char* input = (char*)errhandMalloc(4096);
@@ -31,24 +63,35 @@ void cliRootLoop(PGconn* conn) {
     char* engine_name = NULL;
     int   engine_id;
 
+    completion.conn = conn;
     printf("Welcome to the database-cli!\n");
     while (input[0] != 'Q') {
         cliListRootCommands();
+        cliSetCompletion('R', -1, NULL);
         input = cliReadLine(input);
         input[0] = toupper(input[0]);
 
         switch (input[0]) {
-            case 'E':
-                pqListEngines(conn);
+            case 'E': {
+                const char* previous_format = cliOverrideFormat(input);
+                if (previous_format != NULL) {
+                    pqListEngines(conn);
+                    fmtSetFormat(previous_format);
+                }
                 break;
+            }
             case 'N':
                 input = cliRequestValue("Name of engine", input);
                 engine_name = errhandStrdup(input);
-                printf("Note(s) for every version of %s: ", engine_name);
-                input = cliReadLine(input);
+                char* note_prompt = errhandMalloc(strlen(engine_name) + 32);
+                sprintf(note_prompt, "Note(s) for every version of %s: ",
+                        engine_name);
+                input = cliPromptLine(note_prompt, input);
+                free(note_prompt);
                 char* engine_id_str = pqInsertEngine(
                     conn, engine_name, strlen(input) ? input : NULL);
                 if (engine_id_str != NULL) {
+                    trieInvalidate();
                     cliEngineLoop(conn, engine_name, engine_id_str);
                     free(engine_id_str);
                 }
@@ -71,6 +114,95 @@ void cliRootLoop(PGconn* conn) {
             case 'U':
                 vcsUpdateScan(conn);
                 break;
+            case 'B': {
+                char* path = strchr(input, ' ');
+                if (path == NULL) {
+                    fprintf(stderr, "Path of import file expected.\n");
+                    break;
+                }
+                path += 1; // Move to the index after the space.
+                if (ioImportCatalog(conn, path) != -1) {
+                    trieInvalidate();
+                }
+                break;
+            }
+            case 'D': {
+                char* path = strchr(input, ' ');
+                if (path == NULL) {
+                    fprintf(stderr, "Path of export file expected.\n");
+                    break;
+                }
+                path += 1; // Move to the index after the space.
+                ioExportCatalog(conn, path);
+                break;
+            }
+            case 'L': {
+                char* dir = strchr(input, ' ');
+                if (dir == NULL) {
+                    fprintf(stderr, "Path of logo directory expected.\n");
+                    break;
+                }
+                dir += 1; // Move to the index after the space.
+                ioExportLogos(conn, dir);
+                break;
+            }
+            case 'F': {
+                char* pattern = strchr(input, ' ');
+                if (pattern == NULL) {
+                    fprintf(stderr, "Text to search for expected.\n");
+                    break;
+                }
+                pattern += 1; // Move to the index after the space.
+                pqListEngineMatches(conn, pattern);
+                break;
+            }
+            case 'M': {
+                char* set = strchr(input, ' ');
+                if (set == NULL) {
+                    fprintf(stderr, "Versions to build expected.\n");
+                    break;
+                }
+                set += 1; // Move to the index after the space.
+                // A last word naming variants chooses which to build.
+                char*       last = strrchr(set, ' ');
+                char*       variant_list = NULL;
+                const char* variants[BUILD_VARIANT_COUNT];
+                if (last != NULL &&
+                    buildParseVariants(last + 1, variants) != -1) {
+                    *last = '\0';
+                    variant_list = last + 1;
+                }
+                buildVersions(conn, set, variant_list);
+                break;
+            }
+            case 'G':
+                storeCollectGarbage(conn);
+                break;
+            case 'A':
+                srcCountVersions(conn);
+                break;
+            case 'C':
+                if (cacheIsEnabled()) {
+                    if (cacheDisable(conn) == 0) {
+                        printf("Caching of listings disabled.\n");
+                    }
+                } else if (cacheEnable(conn) == 0) {
+                    printf("Caching of listings enabled.\n");
+                }
+                break;
+            case 'O': {
+                char* format_name = strchr(input, ' ');
+                if (format_name == NULL) {
+                    fmtListFormats();
+                    break;
+                }
+                format_name += 1; // Move to the index after the space.
+                if (fmtSetFormat(format_name) == -1) {
+                    fprintf(stderr, "Output format %s not recognized.\n",
+                            format_name);
+                }
+                break;
+            }
             case 'Q':
                 // Intentional no error, since 'Q' quits loop.
                 break;
@@ -91,16 +223,19 @@ void cliEngineLoop(PGconn* conn, char* engine_name, char* engine_id) {
 
     while (input[0] != 'X') {
         cliListEngineCommands(engine_name);
+        cliSetCompletion('E', -1, engine_id);
         input = cliReadLine(input);
         input[0] = toupper(input[0]);
 
         switch (input[0]) {
-            case 'P':
-                pqListNote(conn, engine_id);
-                pqListAuthors(conn, engine_id);
-                pqListSources(conn, engine_id);
-                pqListVersions(conn, engine_id);
+            case 'P': {
+                const char* previous_format = cliOverrideFormat(input);
+                if (previous_format != NULL) {
+                    pqListEngineDetails(conn, engine_id);
+                    fmtSetFormat(previous_format);
+                }
                 break;
+            }
             case 'A':
                 input = cliRequestValue("Author", input);
                 char* author_name = errhandStrdup(input);
@@ -122,6 +257,7 @@ void cliEngineLoop(PGconn* conn, char* engine_name, char* engine_id) {
                 }
                 version_id = pqInsertVersion(conn, engine_id, version_info);
                 if (version_id != NULL) {
+                    trieInvalidate();
                     cliVersionLoop(conn, engine_id, engine_name, version_id,
                                    version_info.versionNum);
                     free(version_id);
@@ -140,6 +276,7 @@ void cliEngineLoop(PGconn* conn, char* engine_name, char* engine_id) {
                     cliObtainEngineIdFromName(conn, parent_engine_name);
                 if (parent_engine_id != -1) {
                     pqInsertInspiration(conn, engine_id, parent_engine_id);
+                    graphInvalidate();
                 }
                 break;
             case 'D':
@@ -153,8 +290,53 @@ void cliEngineLoop(PGconn* conn, char* engine_name, char* engine_id) {
                     cliObtainEngineIdFromName(conn, parent_engine_name);
                 if (parent_engine_id != -1) {
                     pqInsertPredecessor(conn, engine_id, parent_engine_id);
+                    graphInvalidate();
+                }
+                break;
+            case 'L': {
+                const char* previous_format = cliOverrideFormat(input);
+                if (previous_format != NULL) {
+                    printf("Engines %s derives from:\n", engine_name);
+                    graphListLineage(conn, engine_id, 0);
+                    printf("Engines derived from %s:\n", engine_name);
+                    graphListLineage(conn, engine_id, 1);
+                    fmtSetFormat(previous_format);
+                }
+                break;
+            }
+            case 'F': {
+                char* path = strchr(input, ' ');
+                if (path == NULL) {
+                    fprintf(stderr, "Path of export file expected.\n");
+                    break;
+                }
+                path += 1; // Move to the index after the space.
+                int family_size = graphExportFamily(conn, engine_id, path);
+                if (family_size != -1) {
+                    printf("Wrote %d engines to %s.\n", family_size, path);
+                }
+                break;
+            }
+            case 'W': {
+                char* path = strchr(input, ' ');
+                if (path == NULL) {
+                    fprintf(stderr, "Path of logo file expected.\n");
+                    break;
+                }
+                path += 1; // Move to the index after the space.
+                ioExportLogo(conn, engine_id, path);
+                break;
+            }
+            case 'R': {
+                char* path = strchr(input, ' ');
+                if (path == NULL) {
+                    fprintf(stderr, "Path of logo file expected.\n");
+                    break;
                 }
+                path += 1; // Move to the index after the space.
+                ioImportLogo(conn, engine_id, path);
                 break;
+            }
             case 'S': {
                 char* version_name = strchr(input, ' ');
                 if (version_name == NULL) {
@@ -191,9 +373,14 @@ void cliVersionLoop(PGconn* conn, char* engine_id, char* engine_name,
         input = cliReadLine(input);
         input[0] = toupper(input[0]);
         switch (input[0]) {
-            case 'P':
-                pqListVersionDetails(conn, version_id);
+            case 'P': {
+                const char* previous_format = cliOverrideFormat(input);
+                if (previous_format != NULL) {
+                    pqListVersionDetails(conn, version_id);
+                    fmtSetFormat(previous_format);
+                }
                 break;
+            }
             case 'O': {
                 char* os_name = strchr(input, ' ');
                 if (os_name == NULL) {
@@ -223,14 +410,46 @@ void cliVersionLoop(PGconn* conn, char* engine_id, char* engine_name,
                 }
                 break;
             }
+            case 'B': {
+                const char* previous_format = cliOverrideFormat(input);
+                if (previous_format != NULL) {
+                    buildListBuilds(conn, version_id);
+                    fmtSetFormat(previous_format);
+                }
+                break;
+            }
             case 'W':
                 pqExtractPkgbuild(conn, version_id);
                 break;
-            case 'M':
-                if (pkgRunMakepkg()) {
-                    fprintf(stderr, "Makepkg script returned an error.");
+            case 'A':
+                if (access("PKGBUILD", F_OK) == -1 &&
+                    !pqExtractPkgbuild(conn, version_id)) {
+                    break;
+                }
+                if (srcGeneratePkgbuild() == 0) {
+                    fmtStatus("Review PKGBUILD, then store it with S.\n");
+                }
+                break;
+            case 'L': {
+                const char* previous_format = cliOverrideFormat(input);
+                if (previous_format != NULL) {
+                    if (srcCountVersion(conn, version_id) == 0) {
+                        srcListLangStats(conn, version_id);
+                    }
+                    fmtSetFormat(previous_format);
+                }
+                break;
+            }
+            case 'M': {
+                char* variant = strchr(input, ' ');
+                if (variant != NULL) {
+                    variant += 1; // Move to the index after the space.
+                }
+                if (buildVersion(conn, version_id, variant)) {
+                    fprintf(stderr, "Makepkg script returned an error.\n");
                 }
                 break;
+            }
             case 'S':
                 pqUpdatePkgbuild(conn, version_id);
                 break;
@@ -246,21 +465,37 @@ void cliVersionLoop(PGconn* conn, char* engine_id, char* engine_name,
 
 void cliListRootCommands() {
     printf("\nAccepted database commands:\n");
-    printf("E        (List all engines)\n");
+    printf("E [FMT]  (List all engines, optionally in output format [FMT])\n");
     printf("N        (Create new engine)\n");
+    printf("F [TEXT] (Find engines with names or notes similar to [TEXT])\n");
     printf("S [NAME] (Select existing engine [NAME])\n");
     printf("U        (Check engines for updates)\n");
+    printf("B [FILE] (Bulk import engines from CSV or JSON Lines [FILE])\n");
+    printf("D [FILE] (Dump the catalog to CSV or JSON Lines [FILE])\n");
+    printf("L [DIR]  (Write all engine logos to directory [DIR])\n");
+    printf("M [SET]  (Build [SET]: all, outdated, or engines named like it)\n");
+    printf("         (End [SET] with variants, e.g. generic,native,lto,pgo)\n");
+    printf("G        (Delete stored builds no longer linked from Engines/)\n");
+    printf("A        (Count lines of source of every version by language)\n");
+    printf("O [FMT]  (Set the output format of listings to [FMT])\n");
+    printf("C        (Toggle caching of engine and version listings)\n");
     printf("Q        (Quit)\n");
 }
 
 void cliListEngineCommands(char* engine_name) {
     printf("\nWhat would you like to do with %s?\n", engine_name);
-    printf("P        (Print info for %s)\n", engine_name);
+    printf("P [FMT]  (Print info for %s)\n", engine_name);
     printf("A        (Add new author to %s)\n", engine_name);
     printf("C        (Add new source code URI to %s)\n", engine_name);
     printf("N        (Create new version of %s)\n", engine_name);
     printf("I [NAME] (Add engine [NAME] as an inspiration)\n");
     printf("D [NAME] (Add engine [NAME] as a predecessor)\n");
+    printf("L [FMT]  (List the ancestors and descendants of %s)\n",
+           engine_name);
+    printf("F [FILE] (Export the family of %s to DOT or JSON [FILE])\n",
+           engine_name);
+    printf("W [FILE] (Write the logo of %s to [FILE])\n", engine_name);
+    printf("R [FILE] (Read the logo of %s from [FILE])\n", engine_name);
     printf("S [VER]  (Select existing version [VER])\n");
     printf("X        (Exit to the root menu)\n");
 }
@@ -268,22 +503,150 @@ void cliListEngineCommands(char* engine_name) {
 void cliListVersionCommands(char* engine_name, char* engine_version) {
     printf("\nWhat would you like to do with %s %s?\n", engine_name,
            engine_version);
-    printf("P        (Print info for %s %s)\n", engine_name, engine_version);
+    printf("P [FMT]  (Print info for %s %s)\n", engine_name,
+           engine_version);
     printf("O [OS]   (Add operating system [OS] compatible with %s %s)\n",
            engine_name, engine_version);
     printf("T [EGTB] (Add endgame tablebase [EGTB] compatible with %s %s)\n",
            engine_name, engine_version);
     printf("U        (Pull updates from HEAD)\n");
     printf("W        (Write PKGBUILD to current location)\n");
-    printf("M        (Run makepkg to build engine using current PKGBUILD)\n");
+    printf("A        (Fill in PKGBUILD from the build files of the sources)\n");
+    printf("M [VAR]  (Build variant [VAR] of engine with current PKGBUILD)\n");
+    printf("B [FMT]  (List recent builds of %s %s)\n", engine_name,
+           engine_version);
+    printf("L [FMT]  (Count lines of source of %s %s by language)\n",
+           engine_name, engine_version);
     printf("S        (Store PKGBUILD in directory to %s %s)\n", engine_name,
            engine_version);
     printf("X        (Exit to the engine menu)\n");
 }
 
+#ifdef HAVE_READLINE
+// The names matching the text being completed, handed out one at a time by
+// cliNextMatch with the first match_skip bytes left off.
+static char** matches = NULL;
+static int    match_count = 0;
+static size_t match_skip = 0;
+
+static char* cliNextMatch(const char* text, int state) {
+    static int next;
+    if (state == 0) {
+        next = 0;
+    }
+    if (next == match_count) {
+        return NULL;
+    }
+    // readline frees each match itself.
+    return strdup(matches[next++] + match_skip);
+}
+
+// Returns the kind of name the argument of command is, or -1 if it is not a
+// name, for the current menu.
+static int cliArgumentKind(char command) {
+    command = toupper(command);
+    if (completion.menu == 'R' && (command == 'S' || command == 'F')) {
+        return TRIE_ENGINE;
+    }
+    if (completion.menu == 'E') {
+        if (command == 'I' || command == 'D') {
+            return TRIE_ENGINE;
+        }
+        if (command == 'S') {
+            return TRIE_VERSION;
+        }
+    }
+    return -1;
+}
+
+// Completes names according to completion. readline splits words at spaces,
+// which names may contain, so matches are looked up using the whole name typed
+// so far, then cut down to the part after the start of the word.
+static char** cliComplete(const char* text, int start, int end) {
+    int name_start = 0;
+    int kind = completion.kind;
+    if (completion.menu != 0) {
+        if (rl_line_buffer[0] == '\0' || rl_line_buffer[1] != ' ' ||
+            start < 2) {
+            return NULL;
+        }
+        name_start = 2;
+        kind = cliArgumentKind(rl_line_buffer[0]);
+        if (kind == -1) {
+            return NULL; // Fall back to completing file names.
+        }
+    }
+    rl_attempted_completion_over = 1;
+    if (kind == -1) {
+        return NULL;
+    }
+    // A trailing space would become part of the name.
+    rl_completion_append_character = '\0';
+
+    char* prefix = errhandMalloc(end - name_start + 1);
+    memcpy(prefix, rl_line_buffer + name_start, end - name_start);
+    prefix[end - name_start] = '\0';
+    matches = trieAllocCompletions(
+        completion.conn, kind,
+        kind == TRIE_VERSION ? completion.engine_id : NULL, prefix,
+        &match_count);
+    free(prefix);
+    match_skip = start - name_start;
+
+    char** completions = rl_completion_matches(text, cliNextMatch);
+    for (int i = 0; i < match_count; i++) {
+        free(matches[i]);
+    }
+    free(matches);
+    matches = NULL;
+    match_count = 0;
+    return completions;
+}
+
+// Reads a line with readline, which allows editing, history and completion.
+// readline prints prompt itself, so it is redrawn whenever the line is.
+// Returns 0 on success, or -1 at the end of input.
+static int cliReadLineEdited(const char* prompt, char** s) {
+    rl_attempted_completion_function = cliComplete;
+    fflush(stdout);
+    char* line = readline(prompt);
+    if (line == NULL) {
+        return -1;
+    }
+    if (line[0] != '\0') {
+        add_history(line);
+    }
+    *s = (char*)errhandRealloc(*s, strlen(line) + 1);
+    strcpy(*s, line);
+    free(line);
+    return 0;
+}
+#endif
+
 // Overhauled client input reader. Might make more allocations, though of
 // more consistent and reasonable sizes, with expansion if necessary.
-char* cliReadLine(char* s) {
+// When built with readline and reading from a terminal, lines can be edited
+// and names completed with tab.
+char* cliReadLine(char* s) { return cliPromptLine("", s); }
+
+// Prints prompt and reads a line after it, as cliReadLine does.
+char* cliPromptLine(const char* prompt, char* s) {
+#ifdef HAVE_READLINE
+    static int interactive = -1;
+    if (interactive == -1) {
+        interactive = isatty(STDIN_FILENO);
+    }
+    if (interactive) {
+        int ret = cliReadLineEdited(prompt, &s);
+        cliSetCompletion(0, -1, NULL);
+        if (ret == -1) {
+            fprintf(stderr, "readline returned a NULLPTR.\n");
+            exit(1);
+        }
+        return s;
+    }
+#endif
+    printf("%s", prompt);
     int  temp_len = 256;
     int  buff_len = 0;
     int  used_len = 0;
@@ -307,24 +670,43 @@ char* cliReadLine(char* s) {
 // A wrapper for a very common use of cliReadLine, obtaining a particular
 // data point to be entered into the database.
 char* cliRequestValue(char* explan, char* s) {
+    cli_completion prompt_completion = completion;
     do {
-        printf("%s (cannot be empty): ", explan);
-        s = cliReadLine(s);
+        char* prompt = errhandMalloc(strlen(explan) + 20);
+        sprintf(prompt, "%s (cannot be empty): ", explan);
+        completion = prompt_completion;
+        s = cliPromptLine(prompt, s);
+        free(prompt);
     } while (s[0] == '\0');
     return s;
 }
 
+// Applies the optional [FMT] argument of a listing command for its duration.
+// Returns the format to restore afterwards, or NULL if [FMT] is not a format.
+const char* cliOverrideFormat(char* input) {
+    const char* previous_format = fmtGetFormat();
+    char*       format_name = strchr(input, ' ');
+    if (format_name != NULL && fmtSetFormat(format_name + 1) == -1) {
+        fprintf(stderr, "Output format %s not recognized.\n", format_name + 1);
+        return NULL;
+    }
+    return previous_format;
+}
+
 // A helper function, which determines the ID of an engine based on its name.
 // If multiple engines with the same name exist, asks for user to disambiguate.
 // Returns -1 if no engine with the name exists.
 int cliObtainEngineIdFromName(PGconn* conn, char* engine_name) {
     int  engine_id = -1;
     int* engine_id_list = pqAllocEngineIdsWithName(conn, engine_name);
-    if (engine_id_list == NULL || engine_id_list[0] == 0) {
-        fprintf(stderr, "No engines found with name %s.\n", engine_name);
-        free(engine_id_list);
+    if (engine_id_list == NULL) {
         return -1;
     }
+    if (engine_id_list[0] == 0) {
+        // Nothing matches exactly, so offer the closest matches instead.
+        free(engine_id_list);
+        return cliPickEngineMatch(conn, engine_name);
+    }
     if (engine_id_list[0] == 1) {
         // Exactly one engine was found with that name, so use the found ID.
         engine_id = engine_id_list[1];
@@ -336,8 +718,8 @@ int cliObtainEngineIdFromName(PGconn* conn, char* engine_name) {
         while (!found_id) {
             printf("Multiple engines of the name %s found.\n", engine_name);
             pqListEnginesWithName(conn, engine_name);
-            printf("Select an engine ID from the list to disambiguate: ");
-            input = cliReadLine(input);
+            input = cliPromptLine(
+                "Select an engine ID from the list to disambiguate: ", input);
             engine_id = atoi(input);
             for (int i = 0; i < engine_id_list[0]; i += 1) {
                 if (engine_id == engine_id_list[i + 1]) {
@@ -355,6 +737,41 @@ int cliObtainEngineIdFromName(PGconn* conn, char* engine_name) {
     return engine_id;
 }
 
+// Lists the engines most similar to engine_name, and asks the user to pick one.
+// Returns the ID of the engine picked, or -1 if none was.
+int cliPickEngineMatch(PGconn* conn, char* engine_name) {
+    PGresult* res = pqAllocEngineMatches(conn, engine_name);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    int matches = PQntuples(res);
+    if (!matches) {
+        fprintf(stderr, "No engines found with name %s.\n", engine_name);
+        PQclear(res);
+        return -1;
+    }
+
+    printf("No engine named %s. Similar engines:\n", engine_name);
+    for (int i = 1; i <= matches; i++) {
+        printf("Opt. %d: %s (%s)\n", i, PQgetvalue(res, i - 1, 1),
+               PQgetvalue(res, i - 1, 3));
+    }
+    char* input = (char*)errhandMalloc(4096);
+    int   choice = -1;
+    while (choice < 0 || choice > matches) {
+        input = cliPromptLine(
+            "Select an engine using its option number (0 for none): ", input);
+        choice = (input[0] == '\0') ? 0 : atoi(input);
+    }
+    free(input);
+
+    int engine_id = choice ? atoi(PQgetvalue(res, choice - 1, 0)) : -1;
+    PQclear(res);
+    return engine_id;
+}
+
 char* cliObtainVersionIdFromName(PGconn* conn, char* engine_id,
                                  char* version_name) {
     char* version_id = pqAllocVersionIdWithName(conn, engine_id, version_name);
@@ -408,8 +825,8 @@ version cliAllocVersion(PGconn* conn, char* engine_id) {
             printf("Opt. %d: %s\n", i, sources[i - 1]->uri);
         }
         while (choice <= 0 || choice > dest_elems) {
-            printf("Select a source using its option number: ");
-            buff = cliReadLine(buff);
+            buff = cliPromptLine("Select a source using its option number: ",
+                                 buff);
             choice = atoi(buff);
         }
     }
@@ -417,18 +834,18 @@ version cliAllocVersion(PGconn* conn, char* engine_id) {
     revision rev = {0};
     rev.code_id = errhandStrdup(sources[choice - 1]->id);
     do {
-        printf(
+        buff = cliPromptLine(
             "Select the identifier type of branch, commit, revision number, or "
-            "tag (B/C/R/T): ");
-        buff = cliReadLine(buff);
+            "tag (B/C/R/T): ",
+            buff);
         buff[0] = toupper(buff[0]);
     } while (buff[0] != 'B' && buff[0] != 'C' && buff[0] != 'R' &&
              buff[0] != 'T');
 
     if (buff[0] == 'B') {
-        printf("Name of branch to watch (if blank, defaults to the repo's "
-               "trunk): ");
-        buff = cliReadLine(buff);
+        buff = cliPromptLine("Name of branch to watch (if blank, defaults to "
+                             "the repo's trunk): ",
+                             buff);
         rev.type = 1;
         if (buff[0] != '\0') {
             rev.val = errhandStrdup(buff);
@@ -439,8 +856,8 @@ version cliAllocVersion(PGconn* conn, char* engine_id) {
         int hash_len;
         do {
             hash_len = 0;
-            printf("Commit hash (40 hexadecimal characters): ");
-            buff = cliReadLine(buff);
+            buff = cliPromptLine("Commit hash (40 hexadecimal characters): ",
+                                 buff);
             while (isxdigit(buff[hash_len])) {
                 hash_len += 1;
             }
@@ -449,8 +866,7 @@ version cliAllocVersion(PGconn* conn, char* engine_id) {
         rev.val = errhandStrdup(buff);
     } else if (buff[0] == 'R') {
         do {
-            printf("Revision number: ");
-            buff = cliReadLine(buff);
+            buff = cliPromptLine("Revision number: ", buff);
         } while (atoi(buff) <= 0);
         rev.type = 4;
         rev.val = errhandStrdup(buff);
@@ -466,8 +882,8 @@ version cliAllocVersion(PGconn* conn, char* engine_id) {
 
     struct tm release_date = {.tm_year = -1, .tm_mon = -1, .tm_mday = -1};
     while (release_date.tm_year <= 0) {
-        printf("Year of release (number greater than 1900): ");
-        buff = cliReadLine(buff);
+        buff = cliPromptLine("Year of release (number greater than 1900): ",
+                             buff);
         release_date.tm_year = atoi(buff) - 1900;
     }
     int month_len[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
@@ -476,29 +892,33 @@ version cliAllocVersion(PGconn* conn, char* engine_id) {
         month_len[1] = 29;
     }
     while (release_date.tm_mon < 0 || release_date.tm_mon > 11) {
-        printf("Month of release (number between 1 and 12): ");
-        buff = cliReadLine(buff);
+        buff = cliPromptLine("Month of release (number between 1 and 12): ",
+                             buff);
         release_date.tm_mon = atoi(buff) - 1;
     }
 
     while (release_date.tm_mday < 1 ||
            release_date.tm_mday > month_len[release_date.tm_mon]) {
-        printf("Day of release (number between 1 and %d): ",
-               month_len[release_date.tm_mon]);
-        buff = cliReadLine(buff);
+        char day_prompt[48];
+        snprintf(day_prompt, 48, "Day of release (number between 1 and %d): ",
+                 month_len[release_date.tm_mon]);
+        buff = cliPromptLine(day_prompt, buff);
         release_date.tm_mday = atoi(buff);
     }
     version_data.releaseDate = release_date;
 
+    cliSetCompletion(0, TRIE_CODE_LANG, NULL);
     buff = cliRequestValue("Programming language", buff);
     version_data.programLang = errhandStrdup(buff);
 
     const char* protocols[2] = {"Xboard", "UCI"};
     for (int i = 0; i <= 1; i++) {
         while (1) {
-            printf("Does engine support %s protocol (Y/N, T/F)? ",
-                   protocols[i]);
-            buff = cliReadLine(buff);
+            char protocol_prompt[48];
+            snprintf(protocol_prompt, 48,
+                     "Does engine support %s protocol (Y/N, T/F)? ",
+                     protocols[i]);
+            buff = cliPromptLine(protocol_prompt, buff);
             buff[0] = toupper(buff[0]);
             if (buff[0] == 'Y' || buff[0] == 'T') {
                 version_data.protocol |= (1 << i);
@@ -510,13 +930,13 @@ version cliAllocVersion(PGconn* conn, char* engine_id) {
         }
     }
 
+    cliSetCompletion(0, TRIE_LICENSE, NULL);
     buff = cliRequestValue(
         "License (SPDX identifier, 'None', 'All-Rights-Reserved', or 'Custom')",
         buff);
     version_data.license = errhandStrdup(buff);
 
-    printf("Other notes about this version: ");
-    buff = cliReadLine(buff);
+    buff = cliPromptLine("Other notes about this version: ", buff);
     version_data.note = errhandStrdup(buff);
 
     free(buff);
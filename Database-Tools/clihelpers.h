@@ -28,12 +28,15 @@ extern void cliListRootCommands();
 extern void cliListEngineCommands(char* engine_name);
 extern void cliListVersionCommands(char* engine_name, char* version_name);
 
-extern char* cliReadLine(char* s);
-extern char* cliRequestValue(char* explan, char* s);
-extern int   cliObtainEngineIdFromName(PGconn* conn, char* engine_name);
-extern char* cliObtainVersionIdFromName(PGconn* conn, char* engine_id,
-                                        char* version_name);
-extern int   cliObtainSourceFromEngine(PGconn* conn, char* engine_id);
+extern char*       cliReadLine(char* s);
+extern char*       cliPromptLine(const char* prompt, char* s);
+extern char*       cliRequestValue(char* explan, char* s);
+extern const char* cliOverrideFormat(char* input);
+extern int         cliObtainEngineIdFromName(PGconn* conn, char* engine_name);
+extern int         cliPickEngineMatch(PGconn* conn, char* engine_name);
+extern char*       cliObtainVersionIdFromName(PGconn* conn, char* engine_id,
+                                              char* version_name);
+extern int         cliObtainSourceFromEngine(PGconn* conn, char* engine_id);
 
 extern code_link cliAllocCodeLink();
 extern version   cliAllocVersion(PGconn* conn, char* engine_id);
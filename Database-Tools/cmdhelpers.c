@@ -0,0 +1,349 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define _GNU_SOURCE // for getline
+#include "cmdhelpers.h"
+#include "buildhelpers.h"
+#include "fmthelpers.h"
+#include "globals.h"
+#include "iohelpers.h"
+#include "pqhelpers.h"
+#include "srchelpers.h"
+#include "storehelpers.h"
+#include "vcshelpers.h"
+#include <ctype.h>
+#include <libpq-fe.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The most words a line of a batch file may be split into.
+#define CMD_MAX_ARGS 16
+
+// A subcommand, which is run with argv[0] as its name and between min_args
+// and max_args further arguments. run returns 0 on success, or -1 on failure.
+typedef struct {
+    const char* name;
+    int         min_args;
+    int         max_args;
+    const char* usage;
+    int (*run)(PGconn* conn, int argc, char** argv);
+} cmd_subcommand;
+
+static int cmdScan(PGconn* conn, int argc, char** argv);
+static int cmdList(PGconn* conn, int argc, char** argv);
+static int cmdShow(PGconn* conn, int argc, char** argv);
+static int cmdExport(PGconn* conn, int argc, char** argv);
+static int cmdImport(PGconn* conn, int argc, char** argv);
+static int cmdUpdateVersion(PGconn* conn, int argc, char** argv);
+static int cmdBatch(PGconn* conn, int argc, char** argv);
+static int cmdBuild(PGconn* conn, int argc, char** argv);
+static int cmdGc(PGconn* conn, int argc, char** argv);
+static int cmdCountLines(PGconn* conn, int argc, char** argv);
+static int cmdRefreshLatest(PGconn* conn, int argc, char** argv);
+
+static const cmd_subcommand subcommands[] = {
+    {"scan", 0, 0, "scan", cmdScan},
+    {"list", 0, 1, "list [TEXT]", cmdList},
+    {"show", 1, 2, "show ENGINE [VERSION]", cmdShow},
+    {"export", 1, 1, "export FILE", cmdExport},
+    {"import", 1, 1, "import FILE", cmdImport},
+    {"update-version", 2, 2, "update-version ENGINE VERSION",
+     cmdUpdateVersion},
+    {"batch", 1, 1, "batch FILE|-", cmdBatch},
+    {"build", 1, 2, "build all|outdated|TEXT [VARIANT,...]", cmdBuild},
+    {"gc", 0, 0, "gc", cmdGc},
+    {"count-lines", 0, 0, "count-lines", cmdCountLines},
+    {"refresh-latest", 0, 0, "refresh-latest", cmdRefreshLatest},
+};
+static const int subcommand_count = sizeof(subcommands) / sizeof(*subcommands);
+
+// Set while a batch is running, since batches cannot be nested.
+static int in_batch = 0;
+
+static const cmd_subcommand* cmdFind(const char* name) {
+    for (int i = 0; i < subcommand_count; i++) {
+        if (!strcmp(name, subcommands[i].name)) {
+            return &subcommands[i];
+        }
+    }
+    return NULL;
+}
+
+int cmdIsSubcommand(const char* name) { return cmdFind(name) != NULL; }
+
+void cmdPrintUsage() {
+    fprintf(stderr, "Usage: engine-db-cli [CONNINFO]\n"
+                    "       engine-db-cli [-d CONNINFO] [-f FORMAT] "
+                    "COMMAND [ARGS...]\n"
+                    "Commands:\n");
+    for (int i = 0; i < subcommand_count; i++) {
+        fprintf(stderr, "  %s\n", subcommands[i].usage);
+    }
+}
+
+// Checks that argv[0] names a subcommand and that it is given an acceptable
+// number of arguments, without needing a connection, so that a mistyped
+// command fails before the database is contacted.
+// Returns 0 if the command can be run, or -1 if it cannot.
+int cmdCheckArgs(int argc, char** argv) {
+    const cmd_subcommand* cmd = cmdFind(argv[0]);
+    if (cmd == NULL) {
+        fprintf(stderr, "Command %s not expected.\n", argv[0]);
+        return -1;
+    }
+    if (argc - 1 < cmd->min_args || argc - 1 > cmd->max_args) {
+        fprintf(stderr, "Usage: %s\n", cmd->usage);
+        return -1;
+    }
+    return 0;
+}
+
+// Runs the subcommand named by argv[0] with the remaining arguments.
+// Returns 0 on success, or -1 on failure.
+int cmdRun(PGconn* conn, int argc, char** argv) {
+    if (cmdCheckArgs(argc, argv) == -1) {
+        return -1;
+    }
+    return cmdFind(argv[0])->run(conn, argc, argv);
+}
+
+// Returns the id of the only engine named engine_name, or NULL if there is no
+// such engine or several. Must be freed.
+static char* cmdAllocEngineId(PGconn* conn, char* engine_name) {
+    int* engine_ids = pqAllocEngineIdsWithName(conn, engine_name);
+    if (engine_ids == NULL) {
+        return NULL;
+    }
+    if (engine_ids[0] != 1) {
+        if (engine_ids[0] == 0) {
+            fprintf(stderr, "No engine is named %s.\n", engine_name);
+        } else {
+            fprintf(stderr, "%d engines are named %s.\n", engine_ids[0],
+                    engine_name);
+        }
+        free(engine_ids);
+        return NULL;
+    }
+    char* engine_id = errhandMalloc(12);
+    snprintf(engine_id, 12, "%d", engine_ids[1]);
+    free(engine_ids);
+    return engine_id;
+}
+
+// Returns the id of version version_name of engine_name, or NULL if either
+// does not exist. Must be freed.
+static char* cmdAllocVersionId(PGconn* conn, char* engine_name,
+                               char* version_name) {
+    char* engine_id = cmdAllocEngineId(conn, engine_name);
+    if (engine_id == NULL) {
+        return NULL;
+    }
+    char* version_id = pqAllocVersionIdWithName(conn, engine_id, version_name);
+    if (version_id == NULL) {
+        fprintf(stderr, "%s has no version %s.\n", engine_name, version_name);
+    }
+    free(engine_id);
+    return version_id;
+}
+
+static int cmdScan(PGconn* conn, int argc, char** argv) {
+    return vcsUpdateScan(conn) == -1 ? -1 : 0;
+}
+
+static int cmdList(PGconn* conn, int argc, char** argv) {
+    if (argc == 1) {
+        pqListEngines(conn);
+    } else {
+        pqListEngineMatches(conn, argv[1]);
+    }
+    return 0;
+}
+
+static int cmdShow(PGconn* conn, int argc, char** argv) {
+    if (argc == 3) {
+        char* version_id = cmdAllocVersionId(conn, argv[1], argv[2]);
+        if (version_id == NULL) {
+            return -1;
+        }
+        pqListVersionDetails(conn, version_id);
+        free(version_id);
+        return 0;
+    }
+    char* engine_id = cmdAllocEngineId(conn, argv[1]);
+    if (engine_id == NULL) {
+        return -1;
+    }
+    pqListEngineDetails(conn, engine_id);
+    free(engine_id);
+    return 0;
+}
+
+static int cmdExport(PGconn* conn, int argc, char** argv) {
+    return ioExportCatalog(conn, argv[1]) == -1 ? -1 : 0;
+}
+
+static int cmdImport(PGconn* conn, int argc, char** argv) {
+    return ioImportCatalog(conn, argv[1]) == -1 ? -1 : 0;
+}
+
+static int cmdUpdateVersion(PGconn* conn, int argc, char** argv) {
+    char* version_id = cmdAllocVersionId(conn, argv[1], argv[2]);
+    if (version_id == NULL) {
+        return -1;
+    }
+    int        ret = -1;
+    code_link* source = pqAllocSourceFromVersion(conn, version_id);
+    if (source) {
+        ret = vcsUpdateRevisionInfo(conn, version_id, source);
+        freeCodeLink(*source);
+        free(source);
+    }
+    free(version_id);
+    return ret;
+}
+
+static int cmdBatch(PGconn* conn, int argc, char** argv) {
+    if (in_batch) {
+        fprintf(stderr, "Batches cannot be run from within a batch.\n");
+        return -1;
+    }
+    return cmdRunBatch(conn, argv[1]);
+}
+
+static int cmdBuild(PGconn* conn, int argc, char** argv) {
+    const char* variants = argc == 3 ? argv[2] : NULL;
+    return buildVersions(conn, argv[1], variants) == 0 ? 0 : -1;
+}
+
+static int cmdGc(PGconn* conn, int argc, char** argv) {
+    return storeCollectGarbage(conn) == -1 ? -1 : 0;
+}
+
+static int cmdCountLines(PGconn* conn, int argc, char** argv) {
+    return srcCountVersions(conn) == -1 ? -1 : 0;
+}
+
+// The triggers on version keep latest_version current, so this is only
+// needed after they were bypassed, e.g. by pg_restore --disable-triggers.
+static int cmdRefreshLatest(PGconn* conn, int argc, char** argv) {
+    return pqRefreshLatestVersions(conn);
+}
+
+// Splits line into words in place. Words are separated by whitespace, double
+// quotes group words containing whitespace (with \" and \\ for a literal quote
+// or backslash), and # outside of quotes starts a comment.
+// Returns the number of words, or -1 if a quote is not closed or there are
+// more than max_words words.
+static int cmdSplitLine(char* line, char** words, int max_words) {
+    int   count = 0;
+    char* in = line;
+    while (1) {
+        while (isspace((unsigned char)*in)) {
+            in++;
+        }
+        if (*in == '\0' || *in == '#') {
+            return count;
+        }
+        if (count == max_words) {
+            return -1;
+        }
+        // Words only shrink as quotes are removed, so they are rewritten over
+        // themselves.
+        char* out = in;
+        int   quoted = 0;
+        words[count++] = out;
+        while (*in != '\0' && (quoted || !isspace((unsigned char)*in))) {
+            if (*in == '"') {
+                quoted = !quoted;
+                in++;
+            } else if (quoted && *in == '\\' &&
+                       (in[1] == '"' || in[1] == '\\')) {
+                *out++ = in[1];
+                in += 2;
+            } else {
+                *out++ = *in++;
+            }
+        }
+        if (quoted) {
+            return -1;
+        }
+        int at_end = *in == '\0';
+        *out = '\0';
+        if (at_end) {
+            return count;
+        }
+        in++;
+    }
+}
+
+// Runs each line of path (or stdin if path is "-") as a subcommand, all in a
+// single transaction over this connection. The first failing line rolls the
+// whole batch back, so either every command takes effect or none do.
+// Returns 0 on success, or -1 on failure.
+int cmdRunBatch(PGconn* conn, const char* path) {
+    FILE* fp = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if (fp == NULL) {
+        fprintf(stderr, "Opening of %s failed.\n", path);
+        return -1;
+    }
+    if (ioExec(conn, "BEGIN;") == -1) {
+        if (fp != stdin) {
+            fclose(fp);
+        }
+        return -1;
+    }
+    in_batch = 1;
+
+    char*  line = NULL;
+    size_t line_size = 0;
+    int    line_num = 0;
+    int    commands = 0;
+    int    ret = 0;
+    while (getline(&line, &line_size, fp) != -1) {
+        line_num += 1;
+        char* words[CMD_MAX_ARGS];
+        int   word_count = cmdSplitLine(line, words, CMD_MAX_ARGS);
+        if (word_count == 0) {
+            continue;
+        }
+        // A command which fails on the server leaves the transaction aborted,
+        // even if the command itself does not report the failure.
+        if (word_count == -1 || cmdRun(conn, word_count, words) == -1 ||
+            PQtransactionStatus(conn) != PQTRANS_INTRANS) {
+            fprintf(stderr, "Line %d of %s failed.\n", line_num, path);
+            ret = -1;
+            break;
+        }
+        commands += 1;
+    }
+    free(line);
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    in_batch = 0;
+
+    if (ret == -1) {
+        ioExec(conn, "ROLLBACK;");
+        fprintf(stderr, "The batch was rolled back.\n");
+        return -1;
+    }
+    if (ioExec(conn, "COMMIT;") == -1) {
+        return -1;
+    }
+    fmtStatus("%d commands committed.\n", commands);
+    return 0;
+}
@@ -0,0 +1,28 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef CMDHELPERS_H
+#define CMDHELPERS_H
+
+#include <libpq-fe.h>
+
+extern int  cmdIsSubcommand(const char* name);
+extern int  cmdCheckArgs(int argc, char** argv);
+extern int  cmdRun(PGconn* conn, int argc, char** argv);
+extern int  cmdRunBatch(PGconn* conn, const char* path);
+extern void cmdPrintUsage();
+
+#endif
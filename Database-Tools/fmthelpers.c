@@ -0,0 +1,424 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "fmthelpers.h"
+#include "globals.h"
+#include <ctype.h>
+#include <libpq-fe.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Type OIDs from pg_type which are not quoted when printed as JSON.
+#define BOOLOID    16
+#define INT8OID    20
+#define INT2OID    21
+#define INT4OID    23
+#define OIDOID     26
+#define FLOAT4OID  700
+#define FLOAT8OID  701
+#define NUMERICOID 1700
+
+const int FMT_BUFFER_SIZE = 1 << 16;
+
+static void fmtPrettyBegin(FILE* fp, int nfields, const char** names);
+static void fmtPrettyRow(FILE* fp, int idx, int nfields, const char** names,
+                         const fmt_kind* kinds, const char** values);
+static void fmtPrettyEnd(FILE* fp, int rows);
+static void fmtJsonBegin(FILE* fp, int nfields, const char** names);
+static void fmtJsonRow(FILE* fp, int idx, int nfields, const char** names,
+                       const fmt_kind* kinds, const char** values);
+static void fmtJsonEnd(FILE* fp, int rows);
+static void fmtJsonlRow(FILE* fp, int idx, int nfields, const char** names,
+                        const fmt_kind* kinds, const char** values);
+static void fmtCsvBegin(FILE* fp, int nfields, const char** names);
+static void fmtCsvRow(FILE* fp, int idx, int nfields, const char** names,
+                      const fmt_kind* kinds, const char** values);
+static void fmtTsvBegin(FILE* fp, int nfields, const char** names);
+static void fmtTsvRow(FILE* fp, int idx, int nfields, const char** names,
+                      const fmt_kind* kinds, const char** values);
+static void fmtNoEnd(FILE* fp, int rows);
+
+// The first formatter is the default, and matches the original output.
+static const fmt_formatter formatters[] = {
+    {"pretty", fmtPrettyBegin, fmtPrettyRow, fmtPrettyEnd},
+    {"json", fmtJsonBegin, fmtJsonRow, fmtJsonEnd},
+    {"jsonl", NULL, fmtJsonlRow, fmtNoEnd},
+    {"csv", fmtCsvBegin, fmtCsvRow, fmtNoEnd},
+    {"tsv", fmtTsvBegin, fmtTsvRow, fmtNoEnd},
+};
+static const int formatter_count = sizeof(formatters) / sizeof(*formatters);
+
+static const fmt_formatter* current = &formatters[0];
+static FILE*                stream = NULL;
+
+// Where tables go instead of stream while fmtPrintResultTo prints one.
+static FILE* table_stream = NULL;
+
+// State of the table currently being printed.
+static int             table_fields = 0;
+static const char**    table_names = NULL;
+static const fmt_kind* table_kinds = NULL;
+static int             table_rows = 0;
+
+// State of the document the tables currently being printed belong to.
+static int         document_open = 0;
+static int         document_tables = 0;
+static const char* table_key = NULL;
+
+// Returns 0 if name is a known format, -1 otherwise.
+int fmtSetFormat(const char* name) {
+    for (int i = 0; i < formatter_count; i++) {
+        if (!strcmp(name, formatters[i].name)) {
+            current = &formatters[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* fmtGetFormat() { return current->name; }
+
+void fmtListFormats() {
+    printf("Available output formats:");
+    for (int i = 0; i < formatter_count; i++) {
+        printf(" %s", formatters[i].name);
+    }
+    printf("\nCurrent output format: %s\n", current->name);
+}
+
+// All tables are written to a single duplicate of stdout with a large buffer,
+// so listings are written in a few large writes instead of one per line.
+// stdout itself is left alone, so interactive prompts are unaffected.
+FILE* fmtStream() {
+    if (stream == NULL) {
+        int fd = dup(STDOUT_FILENO);
+        if (fd == -1 || (stream = fdopen(fd, "w")) == NULL) {
+            stream = stdout;
+            return stream;
+        }
+        setvbuf(stream, NULL, _IOFBF, FMT_BUFFER_SIZE);
+    }
+    return stream;
+}
+
+static FILE* fmtTableStream() {
+    return table_stream != NULL ? table_stream : fmtStream();
+}
+
+// The stream fmtStatus prints to.
+FILE* fmtStatusStream() { return current == &formatters[0] ? stdout : stderr; }
+
+// Prints a message which is not part of a table. With any format other than
+// the default, messages go to stderr, so stdout holds nothing but tables.
+void fmtStatus(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(fmtStatusStream(), format, args);
+    va_end(args);
+}
+
+// Groups the tables printed until fmtEndDocument into one document, so that
+// formats which cannot simply be concatenated stay valid. In JSON, the tables
+// become the members of one object, keyed by the names given to
+// fmtNameTable. Other formats print the tables as they would alone.
+void fmtBeginDocument() {
+    document_open = 1;
+    document_tables = 0;
+    if (current->begin == fmtJsonBegin) {
+        fputc('{', fmtTableStream());
+    }
+}
+
+// Names the next table printed in a document. key must remain valid until
+// that table begins.
+void fmtNameTable(const char* key) { table_key = key; }
+
+void fmtEndDocument() {
+    FILE* fp = fmtTableStream();
+    if (current->begin == fmtJsonBegin) {
+        fputs(document_tables ? "\n}\n" : "}\n", fp);
+    }
+    fflush(fp);
+    document_open = 0;
+    table_key = NULL;
+}
+
+// names and kinds must remain valid until fmtEndTable is called.
+void fmtBeginTable(int nfields, const char** names, const fmt_kind* kinds) {
+    FILE* fp = fmtTableStream();
+    // Anything already printed to stdout must come before the table.
+    fflush(stdout);
+    if (document_open && current->begin == fmtJsonBegin) {
+        fputs(document_tables ? ",\n" : "\n", fp);
+        fmtJsonString(fp, table_key != NULL ? table_key : "");
+        fputs(": ", fp);
+    }
+    document_tables += 1;
+    table_key = NULL;
+    table_fields = nfields;
+    table_names = names;
+    table_kinds = kinds;
+    table_rows = 0;
+    if (current->begin != NULL) {
+        current->begin(fp, nfields, names);
+    }
+}
+
+void fmtPrintRow(const char** values) {
+    current->row(fmtTableStream(), table_rows, table_fields, table_names,
+                 table_kinds, values);
+    table_rows += 1;
+}
+
+void fmtEndTable() {
+    FILE* fp = fmtTableStream();
+    current->end(fp, table_rows);
+    fflush(fp);
+    table_fields = 0;
+    table_names = NULL;
+    table_kinds = NULL;
+}
+
+// If calling this function, it is assumed the result of the look-up
+// was successful and res contains table data.
+void fmtPrintResult(PGresult* res) {
+    int          nfields = PQnfields(res);
+    const char** names = errhandMalloc((nfields + 1) * sizeof(char*));
+    const char** values = errhandMalloc((nfields + 1) * sizeof(char*));
+    fmt_kind*    kinds = errhandMalloc((nfields + 1) * sizeof(fmt_kind));
+    for (int j = 0; j < nfields; j++) {
+        names[j] = PQfname(res, j);
+        switch (PQftype(res, j)) {
+            case BOOLOID:
+                kinds[j] = FMT_BOOL;
+                break;
+            case INT8OID:
+            case INT2OID:
+            case INT4OID:
+            case OIDOID:
+            case FLOAT4OID:
+            case FLOAT8OID:
+            case NUMERICOID:
+                kinds[j] = FMT_NUMBER;
+                break;
+            default:
+                kinds[j] = FMT_TEXT;
+        }
+    }
+
+    fmtBeginTable(nfields, names, kinds);
+    for (int i = 0; i < PQntuples(res); i++) {
+        for (int j = 0; j < nfields; j++) {
+            values[j] = PQgetisnull(res, i, j) ? NULL : PQgetvalue(res, i, j);
+        }
+        fmtPrintRow(values);
+    }
+    fmtEndTable();
+
+    free(names);
+    free(values);
+    free(kinds);
+}
+
+// Prints res to fp, e.g. stderr for a table which is not part of a listing.
+void fmtPrintResultTo(FILE* fp, PGresult* res) {
+    // Anything already printed to the table stream must come before it.
+    fflush(fmtStream());
+    table_stream = fp;
+    fmtPrintResult(res);
+    table_stream = NULL;
+}
+
+// Print the table in a format similar to JSON or Rust's debug print
+static void fmtPrettyBegin(FILE* fp, int nfields, const char** names) {
+    fputc('[', fp);
+}
+
+static void fmtPrettyRow(FILE* fp, int idx, int nfields, const char** names,
+                         const fmt_kind* kinds, const char** values) {
+    fputc('\n', fp);
+    for (int j = 0; j < nfields; j++) {
+        fprintf(fp, "  %-15s: %s\n", names[j], values[j] ? values[j] : "");
+    }
+}
+
+static void fmtPrettyEnd(FILE* fp, int rows) { fputs("]\n", fp); }
+
+// Writes s as a quoted JSON string.
+void fmtJsonString(FILE* fp, const char* s) {
+    fputc('"', fp);
+    for (const unsigned char* c = (const unsigned char*)s; *c; c++) {
+        switch (*c) {
+            case '"':
+                fputs("\\\"", fp);
+                break;
+            case '\\':
+                fputs("\\\\", fp);
+                break;
+            case '\n':
+                fputs("\\n", fp);
+                break;
+            case '\r':
+                fputs("\\r", fp);
+                break;
+            case '\t':
+                fputs("\\t", fp);
+                break;
+            default:
+                if (*c < 0x20) {
+                    fprintf(fp, "\\u%04x", *c);
+                } else {
+                    fputc(*c, fp);
+                }
+        }
+    }
+    fputc('"', fp);
+}
+
+static void fmtJsonValue(FILE* fp, fmt_kind kind, const char* value) {
+    if (value == NULL) {
+        fputs("null", fp);
+    } else if (kind == FMT_BOOL) {
+        fputs(value[0] == 't' ? "true" : "false", fp);
+    } else if (kind == FMT_NUMBER &&
+               isdigit((unsigned char)value[value[0] == '-'])) {
+        // NaN, Infinity and -Infinity are valid numerics, but not valid JSON
+        // numbers, so only values with a digit after any sign are unquoted.
+        fputs(value, fp);
+    } else {
+        fmtJsonString(fp, value);
+    }
+}
+
+static void fmtJsonObject(FILE* fp, int nfields, const char** names,
+                          const fmt_kind* kinds, const char** values) {
+    fputc('{', fp);
+    for (int j = 0; j < nfields; j++) {
+        if (j) {
+            fputs(", ", fp);
+        }
+        fmtJsonString(fp, names[j]);
+        fputs(": ", fp);
+        fmtJsonValue(fp, kinds[j], values[j]);
+    }
+    fputc('}', fp);
+}
+
+static void fmtJsonBegin(FILE* fp, int nfields, const char** names) {
+    fputc('[', fp);
+}
+
+static void fmtJsonRow(FILE* fp, int idx, int nfields, const char** names,
+                       const fmt_kind* kinds, const char** values) {
+    fputs(idx ? ",\n  " : "\n  ", fp);
+    fmtJsonObject(fp, nfields, names, kinds, values);
+}
+
+static void fmtJsonEnd(FILE* fp, int rows) {
+    fputs(rows ? "\n]" : "]", fp);
+    // A table in a document is followed by the next member or the closing
+    // brace instead.
+    if (!document_open) {
+        fputc('\n', fp);
+    }
+}
+
+static void fmtJsonlRow(FILE* fp, int idx, int nfields, const char** names,
+                        const fmt_kind* kinds, const char** values) {
+    fmtJsonObject(fp, nfields, names, kinds, values);
+    fputc('\n', fp);
+}
+
+// Quoting follows RFC 4180. NULL is an empty field, while an empty string is
+// quoted, which matches how PostgreSQL's COPY treats CSV.
+static void fmtCsvField(FILE* fp, const char* value) {
+    if (value == NULL) {
+        return;
+    }
+    if (value[0] != '\0' && strpbrk(value, ",\"\r\n") == NULL) {
+        fputs(value, fp);
+        return;
+    }
+    fputc('"', fp);
+    for (const char* c = value; *c; c++) {
+        if (*c == '"') {
+            fputc('"', fp);
+        }
+        fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+static void fmtCsvBegin(FILE* fp, int nfields, const char** names) {
+    for (int j = 0; j < nfields; j++) {
+        if (j) {
+            fputc(',', fp);
+        }
+        fmtCsvField(fp, names[j]);
+    }
+    fputc('\n', fp);
+}
+
+static void fmtCsvRow(FILE* fp, int idx, int nfields, const char** names,
+                      const fmt_kind* kinds, const char** values) {
+    fmtCsvBegin(fp, nfields, values);
+}
+
+// Escaping follows PostgreSQL's COPY text format, with NULL written as \N.
+static void fmtTsvField(FILE* fp, const char* value) {
+    if (value == NULL) {
+        fputs("\\N", fp);
+        return;
+    }
+    for (const char* c = value; *c; c++) {
+        switch (*c) {
+            case '\\':
+                fputs("\\\\", fp);
+                break;
+            case '\t':
+                fputs("\\t", fp);
+                break;
+            case '\n':
+                fputs("\\n", fp);
+                break;
+            case '\r':
+                fputs("\\r", fp);
+                break;
+            default:
+                fputc(*c, fp);
+        }
+    }
+}
+
+static void fmtTsvBegin(FILE* fp, int nfields, const char** names) {
+    for (int j = 0; j < nfields; j++) {
+        if (j) {
+            fputc('\t', fp);
+        }
+        fmtTsvField(fp, names[j]);
+    }
+    fputc('\n', fp);
+}
+
+static void fmtTsvRow(FILE* fp, int idx, int nfields, const char** names,
+                      const fmt_kind* kinds, const char** values) {
+    fmtTsvBegin(fp, nfields, values);
+}
+
+static void fmtNoEnd(FILE* fp, int rows) {}
@@ -0,0 +1,55 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef FMTHELPERS_H
+#define FMTHELPERS_H
+
+#include <libpq-fe.h>
+#include <stdio.h>
+
+// How a column's values should be represented by formats which care about
+// types (e.g. JSON). NULL values are always passed as a NULL char*.
+typedef enum { FMT_TEXT, FMT_NUMBER, FMT_BOOL } fmt_kind;
+
+// A table formatter. begin is called once with the column names, row once per
+// row of values, and end once after the last row.
+typedef struct {
+    const char* name;
+    void (*begin)(FILE* fp, int nfields, const char** names);
+    void (*row)(FILE* fp, int idx, int nfields, const char** names,
+                const fmt_kind* kinds, const char** values);
+    void (*end)(FILE* fp, int rows);
+} fmt_formatter;
+
+extern int         fmtSetFormat(const char* name);
+extern const char* fmtGetFormat();
+extern void        fmtListFormats();
+extern FILE*       fmtStream();
+extern FILE*       fmtStatusStream();
+extern void        fmtStatus(const char* format, ...);
+
+extern void fmtBeginDocument();
+extern void fmtNameTable(const char* key);
+extern void fmtEndDocument();
+extern void fmtBeginTable(int nfields, const char** names,
+                          const fmt_kind* kinds);
+extern void fmtPrintRow(const char** values);
+extern void fmtEndTable();
+extern void fmtPrintResult(PGresult* res);
+extern void fmtPrintResultTo(FILE* fp, PGresult* res);
+extern void fmtJsonString(FILE* fp, const char* s);
+
+#endif
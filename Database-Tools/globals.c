@@ -17,58 +17,368 @@ limitations under the License.
 #define _XOPEN_SOURCE 500
 #include "globals.h"
 #include <ftw.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#ifdef ERRHAND_MEMSTATS
+#include <pthread.h>
+#include <stdint.h>
+#endif
+
+#ifdef ERRHAND_MEMSTATS
+// Every allocation made through the wrappers below is recorded in a table
+// keyed by address, so that its size is known when it is freed. The build
+// links with --wrap=free, so every free in this program passes through
+// __wrap_free, which forgets the allocation if it is recorded.
+extern void __real_free(void* ptr);
+
+typedef struct {
+    const char* file;
+    int         line;
+    size_t      calls;
+    size_t      bytes;
+    size_t      live_count;
+    size_t      live_bytes;
+} mem_site;
+
+typedef struct {
+    void*  ptr;
+    size_t size;
+    int    site;
+} mem_block;
+
+// Far more than there are calls to the wrappers in the source.
+#define MEM_SITE_SLOTS 1024
+
+static mem_site        mem_sites[MEM_SITE_SLOTS];
+static mem_block*      mem_blocks = NULL;
+static size_t          mem_block_cap = 0;
+static size_t          mem_block_count = 0;
+static size_t          mem_calls = 0;
+static size_t          mem_live = 0;
+static size_t          mem_peak = 0;
+static int             mem_at_exit = 0;
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t memHash(void* ptr) {
+    uint64_t h = (uintptr_t)ptr;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    return h;
+}
+
+// Returns the slot of the call site, claiming an empty one on first use.
+static int memSite(const char* file, int line) {
+    size_t slot = (memHash((void*)file) + line) % MEM_SITE_SLOTS;
+    for (int probes = 0; probes < MEM_SITE_SLOTS; probes++) {
+        mem_site* site = &mem_sites[slot];
+        if (site->file == NULL) {
+            site->file = file;
+            site->line = line;
+            return slot;
+        }
+        if (site->line == line && !strcmp(site->file, file)) {
+            return slot;
+        }
+        slot = (slot + 1) % MEM_SITE_SLOTS;
+    }
+    return slot;
+}
+
+// Returns the slot holding ptr, or the empty slot it would be placed in.
+// The table is open-addressed with linear probing, and is never full.
+static size_t memFind(void* ptr) {
+    size_t slot = memHash(ptr) & (mem_block_cap - 1);
+    while (mem_blocks[slot].ptr != NULL && mem_blocks[slot].ptr != ptr) {
+        slot = (slot + 1) & (mem_block_cap - 1);
+    }
+    return slot;
+}
+
+static void memGrow() {
+    mem_block* old_blocks = mem_blocks;
+    size_t     old_cap = mem_block_cap;
+    mem_block_cap = old_cap ? old_cap * 2 : 1024;
+    mem_blocks = calloc(mem_block_cap, sizeof(mem_block));
+    if (mem_blocks == NULL) {
+        fprintf(stderr, "Not enough memory to perform allocation.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old_blocks[i].ptr != NULL) {
+            mem_blocks[memFind(old_blocks[i].ptr)] = old_blocks[i];
+        }
+    }
+    __real_free(old_blocks);
+}
+
+static void memPrintLeaks() {
+    pthread_mutex_lock(&mem_lock);
+    if (mem_block_count != 0) {
+        fprintf(stderr, "%zu allocations (%zu bytes) outstanding at exit:\n",
+                mem_block_count, mem_live);
+        for (int i = 0; i < MEM_SITE_SLOTS; i++) {
+            if (mem_sites[i].live_count != 0) {
+                fprintf(stderr, "  %s:%d: %zu allocations, %zu bytes\n",
+                        mem_sites[i].file, mem_sites[i].line,
+                        mem_sites[i].live_count, mem_sites[i].live_bytes);
+            }
+        }
+    }
+    pthread_mutex_unlock(&mem_lock);
+}
+
+static void memRecord(void* ptr, size_t size, const char* file, int line) {
+    pthread_mutex_lock(&mem_lock);
+    if (!mem_at_exit) {
+        mem_at_exit = 1;
+        atexit(memPrintLeaks);
+    }
+    if ((mem_block_count + 1) * 2 > mem_block_cap) {
+        memGrow();
+    }
+    int site = memSite(file, line);
+    mem_sites[site].calls += 1;
+    mem_sites[site].bytes += size;
+    mem_sites[site].live_count += 1;
+    mem_sites[site].live_bytes += size;
+    mem_blocks[memFind(ptr)] = (mem_block){ptr, size, site};
+    mem_block_count += 1;
+    mem_calls += 1;
+    mem_live += size;
+    if (mem_live > mem_peak) {
+        mem_peak = mem_live;
+    }
+    pthread_mutex_unlock(&mem_lock);
+}
+
+// Removes ptr from the table if it is recorded. Later blocks in the same run
+// of slots are shifted back into the gap, so lookups never stop early.
+static void memForget(void* ptr) {
+    pthread_mutex_lock(&mem_lock);
+    if (mem_block_cap == 0) {
+        pthread_mutex_unlock(&mem_lock);
+        return;
+    }
+    size_t gap = memFind(ptr);
+    if (mem_blocks[gap].ptr == NULL) {
+        pthread_mutex_unlock(&mem_lock);
+        return;
+    }
+    mem_site* site = &mem_sites[mem_blocks[gap].site];
+    site->live_count -= 1;
+    site->live_bytes -= mem_blocks[gap].size;
+    mem_live -= mem_blocks[gap].size;
+    mem_block_count -= 1;
+
+    size_t mask = mem_block_cap - 1;
+    size_t slot = gap;
+    while (1) {
+        slot = (slot + 1) & mask;
+        if (mem_blocks[slot].ptr == NULL) {
+            break;
+        }
+        size_t home = memHash(mem_blocks[slot].ptr) & mask;
+        // A block may only move back if its home is not after the gap.
+        if (((slot - home) & mask) >= ((slot - gap) & mask)) {
+            mem_blocks[gap] = mem_blocks[slot];
+            gap = slot;
+        }
+    }
+    mem_blocks[gap].ptr = NULL;
+    pthread_mutex_unlock(&mem_lock);
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr != NULL) {
+        memForget(ptr);
+    }
+    __real_free(ptr);
+}
+
+static int memCompareCalls(const void* a, const void* b) {
+    const mem_site* site_a = *(const mem_site* const*)a;
+    const mem_site* site_b = *(const mem_site* const*)b;
+    return (site_a->calls < site_b->calls) - (site_a->calls > site_b->calls);
+}
+
+// Prints the heap in use now and at its peak, and the call sites which have
+// allocated most often.
+void errhandPrintMemStats(FILE* fp) {
+    pthread_mutex_lock(&mem_lock);
+    fprintf(fp, "Heap: %zu bytes live in %zu allocations, %zu bytes peak, "
+                "%zu allocations made\n",
+            mem_live, mem_block_count, mem_peak, mem_calls);
+    mem_site* sites[MEM_SITE_SLOTS];
+    int       site_count = 0;
+    for (int i = 0; i < MEM_SITE_SLOTS; i++) {
+        if (mem_sites[i].file != NULL) {
+            sites[site_count++] = &mem_sites[i];
+        }
+    }
+    qsort(sites, site_count, sizeof(*sites), memCompareCalls);
+    for (int i = 0; i < site_count && i < 10; i++) {
+        fprintf(fp, "  %s:%d: %zu calls, %zu bytes\n", sites[i]->file,
+                sites[i]->line, sites[i]->calls, sites[i]->bytes);
+    }
+    pthread_mutex_unlock(&mem_lock);
+}
+
+// The wrappers below take the call site as extra arguments, which the macros
+// in globals.h fill in.
+#define ERRHAND_FN(name) name##At
+#define ERRHAND_SITE , const char* file, int line
+#define ERRHAND_RECORD(ptr, size) memRecord(ptr, size, file, line)
+#define ERRHAND_FORGET(ptr) memForget(ptr)
+#else
+// Allocations are only counted when built with make MEMSTATS=1.
+void errhandPrintMemStats(FILE* fp) {}
+
+#define ERRHAND_FN(name) name
+#define ERRHAND_SITE
+#define ERRHAND_RECORD(ptr, size)
+#define ERRHAND_FORGET(ptr)
+#endif
 
 // Memory is allocated by this function to store ptr.
 // Free must be called when finished with the returned value.
-void* errhandMalloc(size_t size) {
+void* ERRHAND_FN(errhandMalloc)(size_t size ERRHAND_SITE) {
     void* ptr = malloc(size);
     if (ptr == NULL) {
         fprintf(stderr, "Not enough memory to perform allocation.\n");
         exit(1);
     }
+    ERRHAND_RECORD(ptr, size);
     return ptr;
 }
 
 // Memory is allocated by this function to store ptr.
 // Free must be called when finished with the returned value.
-void* errhandCalloc(size_t num, size_t size) {
+void* ERRHAND_FN(errhandCalloc)(size_t num, size_t size ERRHAND_SITE) {
     void* ptr = calloc(num, size);
     if (ptr == NULL) {
         fprintf(stderr, "Not enough memory to perform allocation.\n");
         exit(1);
     }
+    ERRHAND_RECORD(ptr, num * size);
     return ptr;
 }
 
 // Memory is allocated by this function to store new_ptr.
 // Free must be called when finished with the returned value.
 // Note this function can possibly free memory if size = 0.
-void* errhandRealloc(void* ptr, size_t size) {
+void* ERRHAND_FN(errhandRealloc)(void* ptr, size_t size ERRHAND_SITE) {
+    if (ptr != NULL) {
+        ERRHAND_FORGET(ptr);
+    }
     void* new_ptr = realloc(ptr, size);
     if (new_ptr == NULL) {
         fprintf(stderr, "Not enough memory to perform allocation.\n");
         free(ptr);
         exit(1);
     }
+    ERRHAND_RECORD(new_ptr, size);
     return new_ptr;
 }
 
 // Memory is allocated by this function to store new_s
 // Free must be called when finished with the returned value.
-char* errhandStrdup(const char* s) {
+char* ERRHAND_FN(errhandStrdup)(const char* s ERRHAND_SITE) {
     char* new_s = strdup(s);
     if (new_s == NULL) {
         fprintf(stderr, "not enough memory to perform allocation.\n");
         free(new_s);
         exit(1);
     }
+    ERRHAND_RECORD(new_s, strlen(new_s) + 1);
     return new_s;
 }
 
+struct arena_block {
+    arena_block* next;
+    size_t       size;
+    size_t       used;
+};
+
+// Every allocation is aligned as malloc would align it for any basic type.
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+// No memory is allocated until the first call to arenaAlloc.
+void arenaInit(arena* a, size_t block_size) {
+    a->head = NULL;
+    a->block_size = block_size;
+}
+
+// Returns size bytes which stay valid until the arena is reset or freed.
+// Allocations too large for the current block start a new one.
+void* arenaAlloc(arena* a, size_t size) {
+    size = ARENA_ROUND(size);
+    if (a->head == NULL || a->head->size - a->head->used < size) {
+        size_t       block_size = size > a->block_size ? size : a->block_size;
+        arena_block* block =
+            errhandMalloc(ARENA_ROUND(sizeof(arena_block)) + block_size);
+        block->next = a->head;
+        block->size = block_size;
+        block->used = 0;
+        a->head = block;
+    }
+    void* ptr = (char*)a->head + ARENA_ROUND(sizeof(arena_block)) +
+                a->head->used;
+    a->head->used += size;
+    return ptr;
+}
+
+char* arenaStrdup(arena* a, const char* s) {
+    size_t len = strlen(s) + 1;
+    return memcpy(arenaAlloc(a, len), s, len);
+}
+
+// Formats as sprintf into a string allocated from the arena.
+char* arenaSprintf(arena* a, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int   len = vsnprintf(NULL, 0, format, args);
+    char* s = arenaAlloc(a, len + 1);
+    vsnprintf(s, len + 1, format, args_copy);
+    va_end(args_copy);
+    va_end(args);
+    return s;
+}
+
+// Releases everything allocated from the arena, so it can be reused for the
+// next item. If the last item needed more than one block, the blocks are
+// replaced by a single one large enough for all of them, so the arena settles
+// at the size its items need and then stops calling malloc.
+void arenaReset(arena* a) {
+    if (a->head == NULL) {
+        return;
+    }
+    if (a->head->next == NULL) {
+        a->head->used = 0;
+        return;
+    }
+    size_t total = 0;
+    for (arena_block* block = a->head; block != NULL; block = block->next) {
+        total += block->size;
+    }
+    arenaFree(a);
+    a->block_size = total;
+}
+
+void arenaFree(arena* a) {
+    while (a->head != NULL) {
+        arena_block* next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+}
+
 // Frees a version struct created with previous calls to malloc on each char*
 // element
 void freeVersion(version v) {
@@ -88,19 +398,29 @@ void freeCodeLink(code_link cl) {
 revision* allocRevision(char* id, char* frag_type, char* frag_val,
                         int val_is_null) {
     revision* rev = (revision*)errhandMalloc(sizeof(revision));
+    *rev = borrowRevision(id, frag_type, frag_val, val_is_null);
     rev->code_id = errhandStrdup(id);
-    rev->type = (strncmp(frag_type, "branch", 6) == 0)   ? 1
-                : (strncmp(frag_type, "commit", 6) == 0) ? 2
-                : (strncmp(frag_type, "revnum", 6) == 0) ? 4
-                                                         : 8;
-    if (val_is_null) {
-        rev->val = NULL;
-    } else {
+    if (rev->val != NULL) {
         rev->val = errhandStrdup(frag_val);
     }
     return rev;
 }
 
+// Creates a revision which points into the strings given rather than copying
+// them, such as values of a PGresult which outlives it. It must not be passed
+// to freeRevision.
+revision borrowRevision(char* id, char* frag_type, char* frag_val,
+                        int val_is_null) {
+    revision rev;
+    rev.code_id = id;
+    rev.type = (strncmp(frag_type, "branch", 6) == 0)   ? 1
+               : (strncmp(frag_type, "commit", 6) == 0) ? 2
+               : (strncmp(frag_type, "revnum", 6) == 0) ? 4
+                                                        : 8;
+    rev.val = val_is_null ? NULL : frag_val;
+    return rev;
+}
+
 void freeRevision(revision r) {
     free(r.code_id);
     if (r.val != NULL) {
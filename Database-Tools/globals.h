@@ -17,6 +17,8 @@ limitations under the License.
 #ifndef GLOBALS_H
 #define GLOBALS_H
 
+#include <stddef.h>
+#include <stdio.h>
 #include <time.h>
 
 typedef struct {
@@ -41,16 +43,52 @@ typedef struct {
     char* vcs;
 } code_link;
 
+// A bump allocator for short-lived data which is all released at once.
+// Allocations are carved out of blocks of memory, and only the blocks are
+// ever freed, by arenaReset or arenaFree.
+typedef struct arena_block arena_block;
+typedef struct {
+    arena_block* head;
+    size_t       block_size;
+} arena;
+
+#ifdef ERRHAND_MEMSTATS
+// Built with make MEMSTATS=1, every allocation is recorded against the file
+// and line which made it. See errhandPrintMemStats.
+#define errhandMalloc(size) errhandMallocAt(size, __FILE__, __LINE__)
+#define errhandCalloc(num, size) errhandCallocAt(num, size, __FILE__, __LINE__)
+#define errhandRealloc(ptr, size)                                              \
+    errhandReallocAt(ptr, size, __FILE__, __LINE__)
+#define errhandStrdup(s) errhandStrdupAt(s, __FILE__, __LINE__)
+
+extern void* errhandMallocAt(size_t size, const char* file, int line);
+extern void* errhandCallocAt(size_t num, size_t size, const char* file,
+                             int line);
+extern void* errhandReallocAt(void* ptr, size_t size, const char* file,
+                              int line);
+extern char* errhandStrdupAt(const char* s, const char* file, int line);
+#else
 extern void* errhandMalloc(size_t size);
 extern void* errhandCalloc(size_t num, size_t size);
 extern void* errhandRealloc(void* ptr, size_t size);
 extern char* errhandStrdup(const char* s);
+#endif
+extern void errhandPrintMemStats(FILE* fp);
+
+extern void  arenaInit(arena* a, size_t block_size);
+extern void* arenaAlloc(arena* a, size_t size);
+extern char* arenaStrdup(arena* a, const char* s);
+extern char* arenaSprintf(arena* a, const char* format, ...);
+extern void  arenaReset(arena* a);
+extern void  arenaFree(arena* a);
 
 extern void freeVersion(version v);
 extern void freeCodeLink(code_link cl);
 
 extern revision* allocRevision(char* code_id, char* frag_type, char* frag_val,
                                int is_val_null);
+extern revision  borrowRevision(char* code_id, char* frag_type,
+                                char* frag_val, int is_val_null);
 extern void      freeRevision(revision r);
 
 extern time_t readDate(const char* date_str);
@@ -0,0 +1,412 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "graphhelpers.h"
+#include "fmthelpers.h"
+#include "globals.h"
+#include "pqhelpers.h"
+#include <libpq-fe.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The graph used by graphObtain, which is loaded on first use and kept until
+// graphInvalidate is called.
+static lineage_graph* cached_graph = NULL;
+
+// Rows of the graph query are ordered by engine, so a row starts a new node
+// when its engine differs from the previous row's.
+static int graphIsNewNode(PGresult* res, int row) {
+    return row == 0 ||
+           strcmp(PQgetvalue(res, row, 0), PQgetvalue(res, row - 1, 0));
+}
+
+static const char* graphRelationName(char kind) {
+    return kind == 'p' ? "predecessor" : "inspiration";
+}
+
+// This function allocates a lineage_graph* on success, which needs to be freed
+// with graphFree when done.
+// Every engine and relation is read in a single query, ordered by engine so
+// the origins of each node arrive together.
+lineage_graph* graphAllocLineage(PGconn* conn) {
+    PGresult* res = PQexec(
+        conn,
+        "SELECT e.engine_id, e.engine_name, l.origin_engine_id, l.kind "
+        "FROM engine e LEFT JOIN ("
+        "SELECT engine_id, origin_engine_id, 'p' AS kind FROM predecessor "
+        "UNION ALL "
+        "SELECT engine_id, origin_engine_id, 'i' FROM inspiration"
+        ") l USING (engine_id) ORDER BY e.engine_id;");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return NULL;
+    }
+
+    int            rows = PQntuples(res);
+    lineage_graph* graph = errhandCalloc(1, sizeof(lineage_graph));
+    size_t         name_bytes = 0;
+    int            edge_rows = 0;
+    for (int i = 0; i < rows; i++) {
+        if (graphIsNewNode(res, i)) {
+            graph->node_count += 1;
+            name_bytes += PQgetlength(res, i, 1) + 1;
+        }
+        edge_rows += !PQgetisnull(res, i, 2);
+    }
+
+    // One extra element is allocated for each array, so an empty catalog does
+    // not request zero bytes.
+    int nodes = graph->node_count;
+    graph->ids = errhandMalloc((nodes + 1) * sizeof(int));
+    graph->names = errhandMalloc((nodes + 1) * sizeof(char*));
+    graph->name_data = errhandMalloc(name_bytes + 1);
+    graph->origin_start = errhandMalloc((nodes + 1) * sizeof(int));
+    graph->origins = errhandMalloc((edge_rows + 1) * sizeof(int));
+    graph->origin_kinds = errhandMalloc(edge_rows + 1);
+    graph->derived_start = errhandCalloc(nodes + 2, sizeof(int));
+    graph->derived = errhandMalloc((edge_rows + 1) * sizeof(int));
+    graph->derived_kinds = errhandMalloc(edge_rows + 1);
+
+    char* name_end = graph->name_data;
+    int   node = -1;
+    for (int i = 0; i < rows; i++) {
+        if (graphIsNewNode(res, i)) {
+            node += 1;
+            graph->ids[node] = atoi(PQgetvalue(res, i, 0));
+            graph->names[node] = name_end;
+            int name_len = PQgetlength(res, i, 1) + 1;
+            memcpy(name_end, PQgetvalue(res, i, 1), name_len);
+            name_end += name_len;
+        }
+    }
+
+    // The ids are now complete, so origins can be resolved to node indices.
+    int edges = 0;
+    node = -1;
+    for (int i = 0; i < rows; i++) {
+        if (graphIsNewNode(res, i)) {
+            node += 1;
+            graph->origin_start[node] = edges;
+        }
+        if (PQgetisnull(res, i, 2)) {
+            continue;
+        }
+        int origin = graphNodeIndex(graph, atoi(PQgetvalue(res, i, 2)));
+        if (origin == -1) {
+            continue;
+        }
+        graph->origins[edges] = origin;
+        graph->origin_kinds[edges] = PQgetvalue(res, i, 3)[0];
+        graph->derived_start[origin + 1] += 1;
+        edges += 1;
+    }
+    graph->origin_start[nodes] = edges;
+    graph->edge_count = edges;
+    PQclear(res);
+
+    // Transpose the origin lists: count, prefix sum, then place each edge.
+    for (int i = 0; i < nodes; i++) {
+        graph->derived_start[i + 1] += graph->derived_start[i];
+    }
+    int* fill = errhandMalloc((nodes + 1) * sizeof(int));
+    memcpy(fill, graph->derived_start, (nodes + 1) * sizeof(int));
+    for (int i = 0; i < nodes; i++) {
+        for (int e = graph->origin_start[i]; e < graph->origin_start[i + 1];
+             e++) {
+            int slot = fill[graph->origins[e]]++;
+            graph->derived[slot] = i;
+            graph->derived_kinds[slot] = graph->origin_kinds[e];
+        }
+    }
+    free(fill);
+
+    return graph;
+}
+
+void graphFree(lineage_graph* graph) {
+    if (graph == NULL) {
+        return;
+    }
+    free(graph->ids);
+    free(graph->names);
+    free(graph->name_data);
+    free(graph->origin_start);
+    free(graph->origins);
+    free(graph->origin_kinds);
+    free(graph->derived_start);
+    free(graph->derived);
+    free(graph->derived_kinds);
+    free(graph);
+}
+
+// The returned graph is owned by this module and must not be freed.
+// Returns NULL if the graph could not be loaded.
+lineage_graph* graphObtain(PGconn* conn) {
+    if (cached_graph == NULL) {
+        cached_graph = graphAllocLineage(conn);
+    }
+    return cached_graph;
+}
+
+// Must be called after engines or their relations are added, so the next
+// graphObtain reloads the graph.
+void graphInvalidate() {
+    graphFree(cached_graph);
+    cached_graph = NULL;
+}
+
+// Returns the index of engine_id in graph, or -1 if it is not present.
+int graphNodeIndex(const lineage_graph* graph, int engine_id) {
+    int low = 0;
+    int high = graph->node_count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        if (graph->ids[mid] < engine_id) {
+            low = mid + 1;
+        } else if (graph->ids[mid] > engine_id) {
+            high = mid - 1;
+        } else {
+            return mid;
+        }
+    }
+    return -1;
+}
+
+// Sets *graph to the lineage graph and returns the index of engine_id in it.
+// The graph is reloaded once if the engine is missing, since it may have been
+// added since the graph was loaded. Returns -1 if the engine is not found or
+// the graph cannot be loaded, in which case *graph may be NULL.
+static int graphLocate(PGconn* conn, char* engine_id, lineage_graph** graph) {
+    *graph = graphObtain(conn);
+    if (*graph == NULL) {
+        return -1;
+    }
+    int node = graphNodeIndex(*graph, atoi(engine_id));
+    if (node == -1) {
+        graphInvalidate();
+        *graph = graphObtain(conn);
+        if (*graph != NULL) {
+            node = graphNodeIndex(*graph, atoi(engine_id));
+        }
+    }
+    return node;
+}
+
+// Breadth-first search from start, following origins, or derived engines if
+// descendants is nonzero. depth must hold node_count ints, and kinds
+// node_count chars. Returns the number of nodes written to order, which
+// excludes start. A node reached at the same depth by both kinds of relation
+// is reported as a predecessor.
+static int graphWalk(const lineage_graph* graph, int start, int descendants,
+                     int* order, int* depth, char* kinds) {
+    const int*  start_of = descendants ? graph->derived_start
+                                       : graph->origin_start;
+    const int*  edges = descendants ? graph->derived : graph->origins;
+    const char* edge_kinds = descendants ? graph->derived_kinds
+                                         : graph->origin_kinds;
+    for (int i = 0; i < graph->node_count; i++) {
+        depth[i] = -1;
+    }
+
+    int head = 0;
+    int tail = 0;
+    depth[start] = 0;
+    order[tail++] = start;
+    while (head < tail) {
+        int node = order[head++];
+        for (int e = start_of[node]; e < start_of[node + 1]; e++) {
+            int next = edges[e];
+            if (depth[next] == -1) {
+                depth[next] = depth[node] + 1;
+                kinds[next] = edge_kinds[e];
+                order[tail++] = next;
+            } else if (depth[next] == depth[node] + 1 && edge_kinds[e] == 'p') {
+                kinds[next] = 'p';
+            }
+        }
+    }
+    // Drop start from the front of the order.
+    memmove(order, order + 1, (tail - 1) * sizeof(int));
+    return tail - 1;
+}
+
+// Prints the engines engine_id derives from, or the engines derived from it
+// if descendants is nonzero, nearest first. Falls back to a recursive query
+// on the server if the graph cannot be loaded.
+void graphListLineage(PGconn* conn, char* engine_id, int descendants) {
+    lineage_graph* graph;
+    int            start = graphLocate(conn, engine_id, &graph);
+    if (start == -1) {
+        pqListLineage(conn, engine_id, descendants);
+        return;
+    }
+
+    int*  order = errhandMalloc((graph->node_count + 1) * sizeof(int));
+    int*  depth = errhandMalloc((graph->node_count + 1) * sizeof(int));
+    char* kinds = errhandMalloc(graph->node_count + 1);
+    int   found = graphWalk(graph, start, descendants, order, depth, kinds);
+
+    const char*    names[4] = {"engine_id", "engine_name", "relation", "depth"};
+    const fmt_kind field_kinds[4] = {FMT_NUMBER, FMT_TEXT, FMT_TEXT,
+                                     FMT_NUMBER};
+    const char*    values[4];
+    char           id_str[12];
+    char           depth_str[12];
+    fmtBeginTable(4, names, field_kinds);
+    for (int i = 0; i < found; i++) {
+        int node = order[i];
+        snprintf(id_str, 12, "%d", graph->ids[node]);
+        snprintf(depth_str, 12, "%d", depth[node]);
+        values[0] = id_str;
+        values[1] = graph->names[node];
+        values[2] = graphRelationName(kinds[node]);
+        values[3] = depth_str;
+        fmtPrintRow(values);
+    }
+    fmtEndTable();
+
+    free(order);
+    free(depth);
+    free(kinds);
+}
+
+// Writes s as a quoted DOT identifier.
+static void graphDotString(FILE* fp, const char* s) {
+    fputc('"', fp);
+    for (const char* c = s; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', fp);
+        }
+        fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+static void graphWriteDot(FILE* fp, const lineage_graph* graph,
+                          const char* in_family) {
+    fputs("digraph lineage {\n", fp);
+    for (int i = 0; i < graph->node_count; i++) {
+        if (in_family[i]) {
+            fprintf(fp, "    n%d [label=", graph->ids[i]);
+            graphDotString(fp, graph->names[i]);
+            fputs("];\n", fp);
+        }
+    }
+    // Edges point from the origin to the engine derived from it.
+    for (int i = 0; i < graph->node_count; i++) {
+        if (!in_family[i]) {
+            continue;
+        }
+        for (int e = graph->origin_start[i]; e < graph->origin_start[i + 1];
+             e++) {
+            fprintf(fp, "    n%d -> n%d%s;\n", graph->ids[graph->origins[e]],
+                    graph->ids[i],
+                    graph->origin_kinds[e] == 'i' ? " [style=dashed]" : "");
+        }
+    }
+    fputs("}\n", fp);
+}
+
+static void graphWriteJson(FILE* fp, const lineage_graph* graph,
+                           const char* in_family) {
+    int first = 1;
+    fputs("{\"nodes\": [", fp);
+    for (int i = 0; i < graph->node_count; i++) {
+        if (in_family[i]) {
+            fprintf(fp, "%s\n  {\"engine_id\": %d, \"engine_name\": ",
+                    first ? "" : ",", graph->ids[i]);
+            fmtJsonString(fp, graph->names[i]);
+            fputc('}', fp);
+            first = 0;
+        }
+    }
+    first = 1;
+    fputs("\n], \"edges\": [", fp);
+    for (int i = 0; i < graph->node_count; i++) {
+        if (!in_family[i]) {
+            continue;
+        }
+        for (int e = graph->origin_start[i]; e < graph->origin_start[i + 1];
+             e++) {
+            fprintf(fp,
+                    "%s\n  {\"origin_engine_id\": %d, \"engine_id\": %d, "
+                    "\"relation\": \"%s\"}",
+                    first ? "" : ",", graph->ids[graph->origins[e]],
+                    graph->ids[i], graphRelationName(graph->origin_kinds[e]));
+            first = 0;
+        }
+    }
+    fputs("\n]}\n", fp);
+}
+
+// Writes every engine connected to engine_id by any chain of relations, in
+// either direction, to path. A path ending in .json is written as JSON, and
+// anything else as a Graphviz DOT file.
+// Returns the number of engines written, or -1 on failure.
+int graphExportFamily(PGconn* conn, char* engine_id, const char* path) {
+    lineage_graph* graph;
+    int            start = graphLocate(conn, engine_id, &graph);
+    if (start == -1) {
+        if (graph != NULL) {
+            fprintf(stderr, "Engine %s was not found.\n", engine_id);
+        }
+        return -1;
+    }
+
+    // The family is the undirected connected component containing start.
+    char* in_family = errhandCalloc(graph->node_count + 1, 1);
+    int*  queue = errhandMalloc((graph->node_count + 1) * sizeof(int));
+    int   head = 0;
+    int   tail = 0;
+    in_family[start] = 1;
+    queue[tail++] = start;
+    while (head < tail) {
+        int node = queue[head++];
+        for (int e = graph->origin_start[node];
+             e < graph->origin_start[node + 1]; e++) {
+            if (!in_family[graph->origins[e]]) {
+                in_family[graph->origins[e]] = 1;
+                queue[tail++] = graph->origins[e];
+            }
+        }
+        for (int e = graph->derived_start[node];
+             e < graph->derived_start[node + 1]; e++) {
+            if (!in_family[graph->derived[e]]) {
+                in_family[graph->derived[e]] = 1;
+                queue[tail++] = graph->derived[e];
+            }
+        }
+    }
+    free(queue);
+
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open %s for writing.\n", path);
+        free(in_family);
+        return -1;
+    }
+    size_t path_len = strlen(path);
+    if (path_len >= 5 && !strcmp(path + path_len - 5, ".json")) {
+        graphWriteJson(fp, graph, in_family);
+    } else {
+        graphWriteDot(fp, graph, in_family);
+    }
+    fclose(fp);
+    free(in_family);
+    return tail;
+}
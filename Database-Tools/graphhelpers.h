@@ -0,0 +1,50 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef GRAPHHELPERS_H
+#define GRAPHHELPERS_H
+
+#include <libpq-fe.h>
+
+// The predecessor and inspiration relations of every engine, stored in
+// compressed sparse row form. Nodes are indexed by position in ids, which is
+// sorted, and the edges of node i are origins[origin_start[i]] up to (but not
+// including) origins[origin_start[i + 1]], and likewise for derived.
+// Edge kinds are 'p' for a predecessor and 'i' for an inspiration.
+typedef struct {
+    int    node_count;
+    int    edge_count;
+    int*   ids;
+    char** names;
+    char*  name_data;
+    int*   origin_start;
+    int*   origins;
+    char*  origin_kinds;
+    int*   derived_start;
+    int*   derived;
+    char*  derived_kinds;
+} lineage_graph;
+
+extern lineage_graph* graphAllocLineage(PGconn* conn);
+extern void           graphFree(lineage_graph* graph);
+extern lineage_graph* graphObtain(PGconn* conn);
+extern void           graphInvalidate();
+extern int            graphNodeIndex(const lineage_graph* graph, int engine_id);
+
+extern void graphListLineage(PGconn* conn, char* engine_id, int descendants);
+extern int  graphExportFamily(PGconn* conn, char* engine_id, const char* path);
+
+#endif
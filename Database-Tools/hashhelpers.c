@@ -0,0 +1,182 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "hashhelpers.h"
+#include "globals.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const int HASH_CHUNK_SIZE = 1 << 16;
+
+// SHA-256 as specified in FIPS 180-4.
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void hashSha256Block(uint32_t* state, const unsigned char* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        const unsigned char* word = block + 4 * i;
+        w[i] = (uint32_t)word[0] << 24 | (uint32_t)word[1] << 16 |
+               (uint32_t)word[2] << 8 | (uint32_t)word[3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t x = w[i - 15];
+        uint32_t y = w[i - 2];
+        uint32_t s0 = ROTR(x, 7) ^ ROTR(x, 18) ^ (x >> 3);
+        uint32_t s1 = ROTR(y, 17) ^ ROTR(y, 19) ^ (y >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+        uint32_t s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void hashSha256Init(sha256_ctx* ctx) {
+    static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                        0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                        0x1f83d9ab, 0x5be0cd19};
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+void hashSha256Update(sha256_ctx* ctx, const void* data, size_t len) {
+    const unsigned char* bytes = data;
+    ctx->length += len;
+    if (ctx->used) {
+        size_t take = 64 - ctx->used < len ? 64 - ctx->used : len;
+        memcpy(ctx->block + ctx->used, bytes, take);
+        ctx->used += take;
+        bytes += take;
+        len -= take;
+        if (ctx->used < 64) {
+            return;
+        }
+        hashSha256Block(ctx->state, ctx->block);
+        ctx->used = 0;
+    }
+    // Whole blocks are hashed straight from data, without copying.
+    for (; len >= 64; bytes += 64, len -= 64) {
+        hashSha256Block(ctx->state, bytes);
+    }
+    memcpy(ctx->block, bytes, len);
+    ctx->used = len;
+}
+
+// digest must have room for HASH_SHA256_SIZE bytes.
+void hashSha256Final(sha256_ctx* ctx, unsigned char* digest) {
+    uint64_t bits = ctx->length * 8;
+    ctx->block[ctx->used++] = 0x80;
+    if (ctx->used > 56) {
+        memset(ctx->block + ctx->used, 0, 64 - ctx->used);
+        hashSha256Block(ctx->state, ctx->block);
+        ctx->used = 0;
+    }
+    memset(ctx->block + ctx->used, 0, 56 - ctx->used);
+    for (int i = 0; i < 8; i++) {
+        ctx->block[63 - i] = bits >> (8 * i);
+    }
+    hashSha256Block(ctx->state, ctx->block);
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = ctx->state[i] >> 24;
+        digest[4 * i + 1] = ctx->state[i] >> 16;
+        digest[4 * i + 2] = ctx->state[i] >> 8;
+        digest[4 * i + 3] = ctx->state[i];
+    }
+}
+
+void hashSha256(const void* data, size_t len, unsigned char* digest) {
+    sha256_ctx ctx;
+    hashSha256Init(&ctx);
+    hashSha256Update(&ctx, data, len);
+    hashSha256Final(&ctx, digest);
+}
+
+// Hashes the file at path in chunks, so memory use does not depend on its
+// size. If size is not NULL, the size of the file is stored in it.
+// Returns 0 on success, or -1 if the file could not be read.
+int hashSha256File(const char* path, unsigned char* digest, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+    unsigned char* buf = errhandMalloc(HASH_CHUNK_SIZE);
+    size_t         len;
+    sha256_ctx     ctx;
+    hashSha256Init(&ctx);
+    while ((len = fread(buf, 1, HASH_CHUNK_SIZE, fp)) > 0) {
+        hashSha256Update(&ctx, buf, len);
+    }
+    int failed = ferror(fp);
+    fclose(fp);
+    free(buf);
+    if (failed) {
+        return -1;
+    }
+    if (size != NULL) {
+        *size = ctx.length;
+    }
+    hashSha256Final(&ctx, digest);
+    return 0;
+}
+
+// hex must have room for 2 * len + 1 chars.
+void hashToHex(const unsigned char* digest, size_t len, char* hex) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0xf];
+    }
+    hex[2 * len] = '\0';
+}
@@ -0,0 +1,41 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef HASHHELPERS_H
+#define HASHHELPERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH_SHA256_SIZE 32
+
+// The state of a SHA-256 computation over data passed in pieces.
+typedef struct {
+    uint32_t      state[8];
+    uint64_t      length;
+    unsigned char block[64];
+    size_t        used;
+} sha256_ctx;
+
+extern void hashSha256Init(sha256_ctx* ctx);
+extern void hashSha256Update(sha256_ctx* ctx, const void* data, size_t len);
+extern void hashSha256Final(sha256_ctx* ctx, unsigned char* digest);
+extern void hashSha256(const void* data, size_t len, unsigned char* digest);
+extern int  hashSha256File(const char* path, unsigned char* digest,
+                           size_t* size);
+extern void hashToHex(const unsigned char* digest, size_t len, char* hex);
+
+#endif
@@ -0,0 +1,790 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "iohelpers.h"
+#include "fmthelpers.h"
+#include "globals.h"
+#include "hashhelpers.h"
+#include "pqhelpers.h"
+#include <ctype.h>
+#include <libpq-fe.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+const int IO_CHUNK_SIZE = 1 << 16;
+
+// The columns an import file may contain, in the order the export writes them.
+// Each row describes an engine, and optionally one of its sources and one
+// version built from that source. author_name may hold several authors
+// separated by ';'.
+static const char* IMPORT_COLUMNS[] = {
+    "engine_name",  "engine_note", "author_name",    "source_uri",
+    "vcs_name",     "version_name", "frag_type",     "frag_val",
+    "release_date", "code_lang_name", "license_name", "is_xboard",
+    "is_uci",       "version_note"};
+static const int IMPORT_COLUMN_COUNT =
+    sizeof(IMPORT_COLUMNS) / sizeof(*IMPORT_COLUMNS);
+
+static const char* IMPORT_SETUP =
+    "CREATE TEMP TABLE import_stage ("
+    "row_num int GENERATED ALWAYS AS IDENTITY, engine_name text, "
+    "engine_note text, author_name text, source_uri text, vcs_name text, "
+    "version_name text, frag_type text, frag_val text, release_date text, "
+    "code_lang_name text, license_name text, is_xboard text, is_uci text, "
+    "version_note text, error text, engine_id int, source_id int, "
+    "revision_id int) ON COMMIT DROP; "
+    "CREATE TEMP TABLE import_json ("
+    "row_num int GENERATED ALWAYS AS IDENTITY, doc text) ON COMMIT DROP; "
+    "CREATE FUNCTION pg_temp.import_castable(val text, typ text) "
+    "RETURNS bool AS $$ BEGIN "
+    "EXECUTE format('SELECT %L::%s', val, typ); RETURN true; "
+    "EXCEPTION WHEN others THEN RETURN false; "
+    "END; $$ LANGUAGE plpgsql;";
+
+static const char* IMPORT_TEARDOWN =
+    "DROP TABLE import_stage, import_json; "
+    "DROP FUNCTION pg_temp.import_castable(text, text);";
+
+// Each check marks the rows it rejects with a reason, so only the first
+// problem with a row is reported. Rejected rows are left out of the merge.
+static const char* IMPORT_CHECKS[] = {
+    "UPDATE import_stage SET error = 'engine_name is empty' "
+    "WHERE error IS NULL AND coalesce(engine_name, '') = '';",
+
+    // Every value stored in a bounded column is checked against its bound,
+    // since one too long would fail the merge, and so the whole import.
+    "UPDATE import_stage SET error = 'value is too long' "
+    "WHERE error IS NULL AND (length(engine_name) > 255 OR "
+    "length(vcs_name) > 4 OR length(version_name) > 255 OR "
+    "length(frag_val) > 256 OR length(code_lang_name) > 32 OR "
+    "length(license_name) > 64 OR EXISTS (SELECT 1 FROM "
+    "unnest(string_to_array(author_name, ';')) a "
+    "WHERE length(trim(a)) > 255));",
+
+    "UPDATE import_stage s SET error = 'engine_name matches several engines' "
+    "WHERE error IS NULL AND (SELECT count(*) FROM engine e "
+    "WHERE e.engine_name = s.engine_name) > 1;",
+
+    "UPDATE import_stage s SET error = 'vcs_name is not a known vcs' "
+    "WHERE error IS NULL AND coalesce(source_uri, '') <> '' AND NOT EXISTS "
+    "(SELECT 1 FROM vcs v WHERE v.vcs_name = s.vcs_name);",
+
+    "UPDATE import_stage SET error = 'a version requires a source_uri' "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '' "
+    "AND coalesce(source_uri, '') = '';",
+
+    "UPDATE import_stage SET error = "
+    "'frag_type must be branch, commit, revnum, or tag' "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '' AND "
+    "coalesce(frag_type, '') NOT IN ('branch', 'commit', 'revnum', 'tag');",
+
+    "UPDATE import_stage SET error = "
+    "'frag_val is required unless frag_type is branch' "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '' "
+    "AND frag_type <> 'branch' AND coalesce(frag_val, '') = '';",
+
+    "UPDATE import_stage SET error = 'release_date is not a date' "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '' AND "
+    "(coalesce(release_date, '') = '' OR "
+    "NOT pg_temp.import_castable(release_date, 'date'));",
+
+    "UPDATE import_stage s SET error = "
+    "'code_lang_name is not a known language' "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '' AND NOT EXISTS "
+    "(SELECT 1 FROM code_lang c WHERE c.code_lang_name = s.code_lang_name);",
+
+    "UPDATE import_stage SET error = 'license_name is empty' "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '' "
+    "AND coalesce(license_name, '') = '';",
+
+    "UPDATE import_stage SET error = 'is_xboard and is_uci must be booleans' "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '' AND (NOT "
+    "pg_temp.import_castable(coalesce(nullif(is_xboard, ''), 'f'), 'bool') "
+    "OR NOT "
+    "pg_temp.import_castable(coalesce(nullif(is_uci, ''), 'f'), 'bool'));",
+
+    "UPDATE import_stage s SET error = 'version already exists' "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '' AND EXISTS "
+    "(SELECT 1 FROM version v JOIN engine e USING (engine_id) "
+    "WHERE e.engine_name = s.engine_name "
+    "AND v.version_name = s.version_name);",
+
+    "UPDATE import_stage s SET error = 'version is repeated in the file' "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '' AND EXISTS "
+    "(SELECT 1 FROM import_stage t WHERE t.error IS NULL "
+    "AND t.engine_name = s.engine_name AND t.version_name = s.version_name "
+    "AND t.row_num < s.row_num);",
+};
+static const int IMPORT_CHECK_COUNT =
+    sizeof(IMPORT_CHECKS) / sizeof(*IMPORT_CHECKS);
+
+// Names are resolved to ids on the server, inserting whatever is missing.
+// The first statement reports the number of engines inserted, and the last
+// the number of versions inserted.
+static const char* IMPORT_MERGE[] = {
+    "INSERT INTO engine (engine_name, note) "
+    "SELECT DISTINCT ON (engine_name) engine_name, nullif(engine_note, '') "
+    "FROM import_stage s WHERE error IS NULL AND NOT EXISTS "
+    "(SELECT 1 FROM engine e WHERE e.engine_name = s.engine_name) "
+    "ORDER BY engine_name, row_num;",
+
+    "UPDATE import_stage s SET engine_id = e.engine_id FROM engine e "
+    "WHERE s.error IS NULL AND e.engine_name = s.engine_name;",
+
+    "INSERT INTO author (author_name) "
+    "SELECT DISTINCT trim(a) FROM import_stage, "
+    "unnest(string_to_array(author_name, ';')) a "
+    "WHERE error IS NULL AND trim(a) <> '' AND NOT EXISTS "
+    "(SELECT 1 FROM author au WHERE au.author_name = trim(a));",
+
+    "INSERT INTO engine_author (engine_id, author_id) "
+    "SELECT DISTINCT s.engine_id, au.author_id FROM import_stage s "
+    "CROSS JOIN LATERAL unnest(string_to_array(s.author_name, ';')) a "
+    "JOIN (SELECT author_name, min(author_id) AS author_id FROM author "
+    "GROUP BY author_name) au ON au.author_name = trim(a) "
+    "WHERE s.error IS NULL AND NOT EXISTS (SELECT 1 FROM engine_author ea "
+    "WHERE ea.engine_id = s.engine_id AND ea.author_id = au.author_id);",
+
+    "INSERT INTO source (source_uri, vcs_id) "
+    "SELECT DISTINCT ON (source_uri) source_uri, vcs_id "
+    "FROM import_stage s JOIN vcs USING (vcs_name) "
+    "WHERE error IS NULL AND coalesce(source_uri, '') <> '' AND NOT EXISTS "
+    "(SELECT 1 FROM source so WHERE so.source_uri = s.source_uri) "
+    "ORDER BY source_uri, row_num;",
+
+    "UPDATE import_stage s SET source_id = "
+    "(SELECT min(source_id) FROM source so WHERE so.source_uri = s.source_uri) "
+    "WHERE error IS NULL AND coalesce(source_uri, '') <> '';",
+
+    "INSERT INTO engine_source (engine_id, source_id) "
+    "SELECT DISTINCT engine_id, source_id FROM import_stage s "
+    "WHERE error IS NULL AND source_id IS NOT NULL AND NOT EXISTS "
+    "(SELECT 1 FROM engine_source es "
+    "WHERE es.engine_id = s.engine_id AND es.source_id = s.source_id);",
+
+    "INSERT INTO license (license_name) "
+    "SELECT DISTINCT license_name FROM import_stage s "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '' AND NOT EXISTS "
+    "(SELECT 1 FROM license l WHERE l.license_name = s.license_name);",
+
+    "UPDATE import_stage SET revision_id = nextval('revision_id_seq') "
+    "WHERE error IS NULL AND coalesce(version_name, '') <> '';",
+
+    "INSERT INTO revision (revision_id, source_id, frag_type, frag_val) "
+    "SELECT revision_id, source_id, frag_type::fragment, "
+    "nullif(frag_val, '') FROM import_stage WHERE revision_id IS NOT NULL;",
+
+    "INSERT INTO version (engine_id, version_name, revision_id, release_date, "
+    "code_lang_id, license_id, is_xboard, is_uci, note) "
+    "SELECT engine_id, version_name, revision_id, release_date::date, "
+    "(SELECT min(code_lang_id) FROM code_lang c "
+    "WHERE c.code_lang_name = s.code_lang_name), "
+    "(SELECT min(license_id) FROM license l "
+    "WHERE l.license_name = s.license_name), "
+    "coalesce(nullif(is_xboard, ''), 'f')::bool, "
+    "coalesce(nullif(is_uci, ''), 'f')::bool, nullif(version_note, '') "
+    "FROM import_stage s WHERE revision_id IS NOT NULL ORDER BY row_num;",
+};
+static const int IMPORT_MERGE_COUNT =
+    sizeof(IMPORT_MERGE) / sizeof(*IMPORT_MERGE);
+
+// Runs one or more statements which do not return rows.
+// Returns the number of rows affected by the last statement, or -1 on failure.
+int ioExec(PGconn* conn, const char* query) {
+    PGresult* res = PQexec(conn, query);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "Statement failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    int ret = atoi(PQcmdTuples(res));
+
+    PQclear(res);
+    return ret;
+}
+
+// Starts a transaction, or a savepoint if a transaction is already in progress
+// (as in batch mode), so the caller's work can be committed or rolled back as
+// a unit either way. Returns the value to pass to ioCommit or ioRollback, or
+// -1 on failure.
+int ioBegin(PGconn* conn) {
+    if (PQtransactionStatus(conn) == PQTRANS_INTRANS) {
+        return ioExec(conn, "SAVEPOINT io_begin;") == -1 ? -1 : 1;
+    }
+    return ioExec(conn, "BEGIN;") == -1 ? -1 : 0;
+}
+
+// Returns 0 on success, or -1 on failure.
+int ioCommit(PGconn* conn, int nested) {
+    const char* query = nested ? "RELEASE SAVEPOINT io_begin;" : "COMMIT;";
+    return ioExec(conn, query) == -1 ? -1 : 0;
+}
+
+// Returns 0 on success, or -1 on failure.
+int ioRollback(PGconn* conn, int nested) {
+    const char* query = nested ? "ROLLBACK TO SAVEPOINT io_begin; "
+                                 "RELEASE SAVEPOINT io_begin;"
+                               : "ROLLBACK;";
+    return ioExec(conn, query) == -1 ? -1 : 0;
+}
+
+// Streams the rest of fp to the server through a COPY ... FROM STDIN query.
+// fp may be compressed with gzip or not compressed at all.
+// Returns the number of rows copied, or -1 on failure.
+int ioCopyIn(PGconn* conn, const char* query, gzFile fp) {
+    PGresult* res = PQexec(conn, query);
+    if (PQresultStatus(res) != PGRES_COPY_IN) {
+        fprintf(stderr, "COPY failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+
+    char*       buf = errhandMalloc(IO_CHUNK_SIZE);
+    int         len;
+    const char* err = NULL;
+    while ((len = gzread(fp, buf, IO_CHUNK_SIZE)) > 0) {
+        if (PQputCopyData(conn, buf, len) != 1) {
+            err = "sending data failed";
+            break;
+        }
+    }
+    if (len < 0) {
+        err = "reading the file failed";
+    }
+    free(buf);
+
+    if (PQputCopyEnd(conn, err) != 1) {
+        fprintf(stderr, "COPY failed: %s", PQerrorMessage(conn));
+        return -1;
+    }
+    int ret = -1;
+    res = PQgetResult(conn);
+    if (PQresultStatus(res) == PGRES_COMMAND_OK) {
+        ret = atoi(PQcmdTuples(res));
+    } else {
+        fprintf(stderr, "COPY failed: %s", PQerrorMessage(conn));
+    }
+    PQclear(res);
+    // The COPY is complete once PQgetResult returns NULL.
+    while ((res = PQgetResult(conn)) != NULL) {
+        PQclear(res);
+    }
+    return ret;
+}
+
+// Returns 1 if path names a JSON Lines file, ignoring any .gz suffix.
+static int ioPathIsJsonl(const char* path) {
+    size_t len = strlen(path);
+    if (len > 3 && !strcmp(path + len - 3, ".gz")) {
+        len -= 3;
+    }
+    return len > 6 && !strncmp(path + len - 6, ".jsonl", 6);
+}
+
+// Reads the header line of a CSV file into a column list usable by COPY, so
+// columns may be given in any order and unused ones left out.
+// Returns 0 on success, -1 if the header names an unknown column.
+static int ioReadCsvHeader(gzFile fp, char* columns, size_t size) {
+    char line[1024];
+    if (gzgets(fp, line, sizeof(line)) == NULL) {
+        fprintf(stderr, "Import file is empty.\n");
+        return -1;
+    }
+    columns[0] = '\0';
+    // Spreadsheet programs like to start their CSV files with a UTF-8 BOM.
+    char* start = strncmp(line, "\xEF\xBB\xBF", 3) ? line : line + 3;
+    char* saveptr;
+    for (char* name = strtok_r(start, ",", &saveptr); name != NULL;
+         name = strtok_r(NULL, ",", &saveptr)) {
+        // Strip whitespace, line endings, and quotes around the name.
+        while (isspace((unsigned char)*name) || *name == '"') {
+            name += 1;
+        }
+        size_t len = strlen(name);
+        while (len > 0 && (isspace((unsigned char)name[len - 1]) ||
+                           name[len - 1] == '"')) {
+            len -= 1;
+        }
+        name[len] = '\0';
+
+        int known = 0;
+        for (int i = 0; i < IMPORT_COLUMN_COUNT; i++) {
+            if (!strcmp(name, IMPORT_COLUMNS[i])) {
+                known = 1;
+                break;
+            }
+        }
+        if (!known) {
+            fprintf(stderr, "Column %s is not an import column.\n", name);
+            return -1;
+        }
+        if (strlen(columns) + len + 3 > size) {
+            fprintf(stderr, "Import file header is too long.\n");
+            return -1;
+        }
+        if (columns[0] != '\0') {
+            strcat(columns, ", ");
+        }
+        strcat(columns, name);
+    }
+    if (columns[0] == '\0') {
+        fprintf(stderr, "Import file header has no columns.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Streams the JSON Lines in fp into import_json, one line per row, then
+// unpacks each object into import_stage. Returns -1 on failure.
+static int ioStageJsonl(PGconn* conn, gzFile fp) {
+    // A CSV COPY with control characters as the quote and delimiter reads
+    // each line verbatim, where the text format would mangle backslashes.
+    if (ioCopyIn(conn,
+                 "COPY import_json (doc) FROM STDIN "
+                 "(FORMAT csv, QUOTE e'\\x01', DELIMITER e'\\x02');",
+                 fp) == -1) {
+        return -1;
+    }
+
+    char query[4096];
+    int  len = snprintf(query, sizeof(query),
+                        "INSERT INTO import_stage (row_num, error");
+    for (int i = 0; i < IMPORT_COLUMN_COUNT; i++) {
+        len += snprintf(query + len, sizeof(query) - len, ", %s",
+                        IMPORT_COLUMNS[i]);
+    }
+    len += snprintf(query + len, sizeof(query) - len,
+                    ") OVERRIDING SYSTEM VALUE SELECT row_num, CASE WHEN d IS "
+                    "NULL THEN 'line is not a JSON object' END");
+    for (int i = 0; i < IMPORT_COLUMN_COUNT; i++) {
+        len += snprintf(query + len, sizeof(query) - len, ", d->>'%s'",
+                        IMPORT_COLUMNS[i]);
+    }
+    snprintf(query + len, sizeof(query) - len,
+             " FROM (SELECT row_num, CASE WHEN "
+             "pg_temp.import_castable(doc, 'jsonb') AND "
+             "jsonb_typeof(doc::jsonb) = 'object' THEN doc::jsonb END AS d "
+             "FROM import_json WHERE doc IS NOT NULL) j;");
+
+    return ioExec(conn, query);
+}
+
+// Imports engines, authors, sources, and versions from a CSV file with a
+// header row, or a JSON Lines file if path ends in .jsonl (or .jsonl.gz).
+// Rows which cannot be imported are reported and skipped, and everything else
+// is merged in a single transaction.
+// Returns the number of rows merged, or -1 on failure.
+int ioImportCatalog(PGconn* conn, const char* path) {
+    gzFile fp = gzopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Opening of %s failed.\n", path);
+        return -1;
+    }
+    gzbuffer(fp, IO_CHUNK_SIZE);
+    int is_jsonl = ioPathIsJsonl(path);
+
+    char columns[1024];
+    if (!is_jsonl && ioReadCsvHeader(fp, columns, sizeof(columns)) == -1) {
+        gzclose(fp);
+        return -1;
+    }
+
+    int nested = ioBegin(conn);
+    if (nested == -1) {
+        gzclose(fp);
+        return -1;
+    }
+    if (ioExec(conn, IMPORT_SETUP) == -1) {
+        gzclose(fp);
+        ioRollback(conn, nested);
+        return -1;
+    }
+
+    int staged;
+    if (is_jsonl) {
+        staged = ioStageJsonl(conn, fp);
+    } else {
+        char query[1200];
+        snprintf(query, sizeof(query),
+                 "COPY import_stage (%s) FROM STDIN (FORMAT csv);", columns);
+        staged = ioCopyIn(conn, query, fp);
+    }
+    gzclose(fp);
+    if (staged == -1) {
+        ioRollback(conn, nested);
+        return -1;
+    }
+
+    for (int i = 0; i < IMPORT_CHECK_COUNT; i++) {
+        if (ioExec(conn, IMPORT_CHECKS[i]) == -1) {
+            ioRollback(conn, nested);
+            return -1;
+        }
+    }
+
+    int engines = 0;
+    int versions = 0;
+    for (int i = 0; i < IMPORT_MERGE_COUNT; i++) {
+        int count = ioExec(conn, IMPORT_MERGE[i]);
+        if (count == -1) {
+            ioRollback(conn, nested);
+            return -1;
+        }
+        if (i == 0) {
+            engines = count;
+        } else if (i == IMPORT_MERGE_COUNT - 1) {
+            versions = count;
+        }
+    }
+
+    // Rows are reported by the line of the file they were read from, which
+    // for a CSV file is one past their row_num for its header.
+    char report[160];
+    snprintf(report, sizeof(report),
+             "SELECT row_num + %d AS line, engine_name, version_name, error "
+             "FROM import_stage WHERE error IS NOT NULL ORDER BY row_num;",
+             is_jsonl ? 0 : 1);
+    PGresult* res = PQexec(conn, report);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        ioRollback(conn, nested);
+        return -1;
+    }
+    int rejected = PQntuples(res);
+    if (rejected) {
+        fprintf(stderr, "%d rows were not imported:\n", rejected);
+        fmtPrintResultTo(stderr, res);
+    }
+    PQclear(res);
+
+    // Within an enclosing transaction, the staging tables would otherwise
+    // outlive the import and clash with the next one.
+    if (ioExec(conn, IMPORT_TEARDOWN) == -1 || ioCommit(conn, nested) == -1) {
+        ioRollback(conn, nested);
+        return -1;
+    }
+    fmtStatus("%d rows read, %d imported, %d rejected.\n", staged,
+              staged - rejected, rejected);
+    fmtStatus("%d engines and %d versions inserted.\n", engines, versions);
+
+    return staged - rejected;
+}
+
+// Streams the rows of a COPY ... TO STDOUT query into fp one at a time, so
+// memory use does not depend on the size of the result.
+// Returns the number of rows copied, or -1 on failure.
+int ioCopyOut(PGconn* conn, const char* query, gzFile fp) {
+    PGresult* res = PQexec(conn, query);
+    if (PQresultStatus(res) != PGRES_COPY_OUT) {
+        fprintf(stderr, "COPY failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+
+    char* buf;
+    int   len;
+    int   write_failed = 0;
+    while ((len = PQgetCopyData(conn, &buf, 0)) > 0) {
+        // Keep reading after a failed write, since the COPY must be finished
+        // before the connection can be used again.
+        if (!write_failed && gzwrite(fp, buf, len) != len) {
+            write_failed = 1;
+        }
+        PQfreemem(buf);
+    }
+
+    int ret = -1;
+    res = PQgetResult(conn);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "COPY failed: %s", PQerrorMessage(conn));
+    } else if (write_failed) {
+        fprintf(stderr, "Writing the copied rows failed.\n");
+    } else {
+        ret = atoi(PQcmdTuples(res));
+    }
+    PQclear(res);
+    while ((res = PQgetResult(conn)) != NULL) {
+        PQclear(res);
+    }
+    return ret;
+}
+
+// Exports the catalog view to path as CSV with a header row, or as JSON Lines
+// if path ends in .jsonl. If path also ends in .gz, the output is compressed.
+// The output can be read back in by ioImportCatalog.
+// Returns the number of rows exported, or -1 on failure.
+int ioExportCatalog(PGconn* conn, const char* path) {
+    size_t len = strlen(path);
+    int    compress = len > 3 && !strcmp(path + len - 3, ".gz");
+    // "T" asks zlib to write the file without compression.
+    gzFile fp = gzopen(path, compress ? "wb6" : "wbT");
+    if (!fp) {
+        fprintf(stderr, "Creation or opening of %s failed.\n", path);
+        return -1;
+    }
+    gzbuffer(fp, IO_CHUNK_SIZE);
+
+    int rows;
+    if (ioPathIsJsonl(path)) {
+        // As with the import, control characters as the quote and delimiter
+        // leave each JSON object exactly as the server formatted it.
+        rows = ioCopyOut(conn,
+                         "COPY (SELECT row_to_json(c) FROM (SELECT * FROM "
+                         "catalog ORDER BY engine_name, release_date NULLS "
+                         "FIRST, version_name) c) TO STDOUT "
+                         "(FORMAT csv, QUOTE e'\\x01', DELIMITER e'\\x02');",
+                         fp);
+    } else {
+        rows = ioCopyOut(conn,
+                         "COPY (SELECT * FROM catalog ORDER BY engine_name, "
+                         "release_date NULLS FIRST, version_name) TO STDOUT "
+                         "(FORMAT csv, HEADER true);",
+                         fp);
+    }
+    if (gzclose(fp) != Z_OK && rows != -1) {
+        fprintf(stderr, "Writing %s failed.\n", path);
+        return -1;
+    }
+    if (rows != -1) {
+        fmtStatus("%d rows exported to %s.\n", rows, path);
+    }
+    return rows;
+}
+
+// The size and hash of a logo, which are stored alongside logo_img so they can
+// be compared without transferring the image.
+typedef struct {
+    char          logo_id[12];
+    size_t        size;
+    unsigned char sha256[HASH_SHA256_SIZE];
+} logo_digest;
+
+// Looks up the logo of engine_id, using the one added first if there are
+// several. The result is requested in binary, so the hash arrives as raw bytes.
+// Returns 1 if the engine has a logo, 0 if not, or -1 on failure.
+static int ioFetchLogoDigest(PGconn* conn, char* engine_id,
+                             logo_digest* digest) {
+    const char* paramValues[1] = {engine_id};
+
+    PGresult* res = PQexecParams(
+        conn,
+        "SELECT logo_id, logo_size, logo_sha256 FROM logo "
+        "WHERE engine_id = $1 AND logo_img IS NOT NULL "
+        "ORDER BY logo_id LIMIT 1;",
+        1, NULL, paramValues, NULL, NULL, 1);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    if (PQntuples(res) == 0) {
+        PQclear(res);
+        return 0;
+    }
+    snprintf(digest->logo_id, sizeof(digest->logo_id), "%d",
+             pqGetIntValue(res, 0, 0));
+    digest->size = pqGetIntValue(res, 0, 1);
+    memcpy(digest->sha256, PQgetvalue(res, 0, 2), HASH_SHA256_SIZE);
+
+    PQclear(res);
+    return 1;
+}
+
+// Returns 1 if the file at path has the size and hash in digest, 0 otherwise.
+static int ioFileMatchesDigest(const char* path, const logo_digest* digest) {
+    unsigned char sha256[HASH_SHA256_SIZE];
+    size_t        size;
+    return hashSha256File(path, sha256, &size) == 0 && size == digest->size &&
+           !memcmp(sha256, digest->sha256, HASH_SHA256_SIZE);
+}
+
+// Writes the logo with id logo_id to path. The server copies the logo into a
+// large object, which the client reads into path in chunks, so the image is
+// never held in memory whole. The large object is discarded by rolling back.
+static int ioExportLogoById(PGconn* conn, const char* logo_id,
+                            const char* path) {
+    const char* paramValues[1] = {logo_id};
+
+    int nested = ioBegin(conn);
+    if (nested == -1) {
+        return -1;
+    }
+    PGresult* res = PQexecParams(
+        conn, "SELECT lo_from_bytea(0, logo_img) FROM logo WHERE logo_id = $1;",
+        1, NULL, paramValues, NULL, NULL, 1);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != 1) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        ioRollback(conn, nested);
+        return -1;
+    }
+    // An oid is an unsigned int4, which has the same binary format.
+    Oid oid = (Oid)pqGetIntValue(res, 0, 0);
+    PQclear(res);
+
+    int ret = lo_export(conn, oid, path) == 1 ? 0 : -1;
+    if (ret == -1) {
+        fprintf(stderr, "Exporting the logo to %s failed: %s", path,
+                PQerrorMessage(conn));
+    }
+    ioRollback(conn, nested);
+    return ret;
+}
+
+// Writes the logo of engine_id to path, unless path already holds it.
+// Returns 1 if the logo was written, 0 if it was unchanged, or -1 on failure.
+int ioExportLogo(PGconn* conn, char* engine_id, const char* path) {
+    logo_digest digest;
+    int         found = ioFetchLogoDigest(conn, engine_id, &digest);
+    if (found == 0) {
+        fprintf(stderr, "The engine has no logo.\n");
+    }
+    if (found != 1) {
+        return -1;
+    }
+    if (ioFileMatchesDigest(path, &digest)) {
+        printf("%s already holds the logo.\n", path);
+        return 0;
+    }
+    if (ioExportLogoById(conn, digest.logo_id, path) == -1) {
+        return -1;
+    }
+    printf("Wrote %zu bytes to %s.\n", digest.size, path);
+    return 1;
+}
+
+// Stores the file at path as the logo of engine_id, replacing its existing
+// logo if it has one, unless the existing logo is identical. The client sends
+// the file in chunks into a large object, which the server copies into
+// logo_img before the large object is removed.
+// Returns 1 if the logo was stored, 0 if it was unchanged, or -1 on failure.
+int ioImportLogo(PGconn* conn, char* engine_id, const char* path) {
+    logo_digest local;
+    if (hashSha256File(path, local.sha256, &local.size) == -1) {
+        fprintf(stderr, "Reading %s failed.\n", path);
+        return -1;
+    }
+    logo_digest remote;
+    int         found = ioFetchLogoDigest(conn, engine_id, &remote);
+    if (found == -1) {
+        return -1;
+    }
+    if (found && remote.size == local.size &&
+        !memcmp(remote.sha256, local.sha256, HASH_SHA256_SIZE)) {
+        printf("The logo is already identical to %s.\n", path);
+        return 0;
+    }
+
+    int nested = ioBegin(conn);
+    if (nested == -1) {
+        return -1;
+    }
+    Oid oid = lo_import(conn, path);
+    if (oid == InvalidOid) {
+        fprintf(stderr, "Importing %s failed: %s", path, PQerrorMessage(conn));
+        ioRollback(conn, nested);
+        return -1;
+    }
+    char oid_str[12];
+    snprintf(oid_str, 12, "%u", oid);
+    const char* paramValues[2] = {oid_str,
+                                  found ? remote.logo_id : engine_id};
+
+    PGresult* res = PQexecParams(
+        conn,
+        found ? "UPDATE logo SET logo_img = lo_get($1) WHERE logo_id = $2;"
+              : "INSERT INTO logo (engine_id, logo_img) "
+                "VALUES ($2, lo_get($1));",
+        2, NULL, paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "%s failed: %s", found ? "UPDATE" : "INSERT",
+                PQerrorMessage(conn));
+        PQclear(res);
+        ioRollback(conn, nested);
+        return -1;
+    }
+    PQclear(res);
+
+    if (lo_unlink(conn, oid) == -1 || ioCommit(conn, nested) == -1) {
+        ioRollback(conn, nested);
+        return -1;
+    }
+    printf("Stored %zu bytes from %s.\n", local.size, path);
+    return 1;
+}
+
+// Writes every logo to dir, named by engine id with an extension guessed
+// from its first bytes. Only sizes and hashes are read up front, and logos
+// whose file already matches are skipped, so an unchanged catalog transfers
+// no image data at all.
+// Returns the number of logos written, or -1 on failure.
+int ioExportLogos(PGconn* conn, const char* dir) {
+    PGresult* res = PQexecParams(
+        conn,
+        "SELECT DISTINCT ON (engine_id) logo_id, engine_id, logo_size, "
+        "logo_sha256, substring(logo_img FROM 1 FOR 8) FROM logo "
+        "WHERE logo_img IS NOT NULL ORDER BY engine_id, logo_id;",
+        0, NULL, NULL, NULL, NULL, 1);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+
+    int written = 0;
+    int unchanged = 0;
+    for (int i = 0; i < PQntuples(res); i++) {
+        logo_digest digest;
+        snprintf(digest.logo_id, sizeof(digest.logo_id), "%d",
+                 pqGetIntValue(res, i, 0));
+        int engine_id = pqGetIntValue(res, i, 1);
+        digest.size = pqGetIntValue(res, i, 2);
+        memcpy(digest.sha256, PQgetvalue(res, i, 3), HASH_SHA256_SIZE);
+
+        const char* magic = PQgetvalue(res, i, 4);
+        int         magic_len = PQgetlength(res, i, 4);
+        const char* ext = "bin";
+        if (magic_len >= 8 && !memcmp(magic, "\x89PNG\r\n\x1a\n", 8)) {
+            ext = "png";
+        } else if (magic_len >= 3 && !memcmp(magic, "\xff\xd8\xff", 3)) {
+            ext = "jpg";
+        } else if (magic_len >= 4 && !memcmp(magic, "GIF8", 4)) {
+            ext = "gif";
+        } else if (magic_len >= 2 && !memcmp(magic, "BM", 2)) {
+            ext = "bmp";
+        } else if (magic_len >= 1 && magic[0] == '<') {
+            ext = "svg";
+        }
+
+        char path[4096];
+        snprintf(path, 4096, "%s/%d.%s", dir, engine_id, ext);
+        if (ioFileMatchesDigest(path, &digest)) {
+            unchanged += 1;
+        } else if (ioExportLogoById(conn, digest.logo_id, path) == 0) {
+            written += 1;
+        }
+    }
+    printf("Wrote %d logos to %s, %d were unchanged.\n", written, dir,
+           unchanged);
+
+    PQclear(res);
+    return written;
+}
@@ -0,0 +1,36 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef IOHELPERS_H
+#define IOHELPERS_H
+
+#include <libpq-fe.h>
+#include <zlib.h>
+
+extern int ioImportCatalog(PGconn* conn, const char* path);
+extern int ioExportCatalog(PGconn* conn, const char* path);
+extern int ioImportLogo(PGconn* conn, char* engine_id, const char* path);
+extern int ioExportLogo(PGconn* conn, char* engine_id, const char* path);
+extern int ioExportLogos(PGconn* conn, const char* dir);
+
+extern int ioExec(PGconn* conn, const char* query);
+extern int ioBegin(PGconn* conn);
+extern int ioCommit(PGconn* conn, int nested);
+extern int ioRollback(PGconn* conn, int nested);
+extern int ioCopyIn(PGconn* conn, const char* query, gzFile fp);
+extern int ioCopyOut(PGconn* conn, const char* query, gzFile fp);
+
+#endif
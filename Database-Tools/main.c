@@ -15,31 +15,79 @@ limitations under the License.
 */
 
 #include "clihelpers.h"
+#include "cmdhelpers.h"
+#include "fmthelpers.h"
 #include "pqhelpers.h"
-#include <git2.h>
+#include "vcshelpers.h"
 #include <libpq-fe.h>
-#include <svn_cmdline.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 int main(int argc, char** argv) {
-    const char* conninfo;
+    const char* conninfo = "dbname=engine_db";
+    const char* format = NULL;
     PGconn*     conn;
+    int         argi = 1;
 
-    if (argc > 1) {
-        conninfo = argv[1];
-    } else {
-        conninfo = "dbname=engine_db";
+    while (argi < argc && argv[argi][0] == '-') {
+        if (!strcmp(argv[argi], "-h") || !strcmp(argv[argi], "--help")) {
+            cmdPrintUsage();
+            return EXIT_SUCCESS;
+        }
+        if (argi + 1 == argc) {
+            cmdPrintUsage();
+            return EXIT_FAILURE;
+        }
+        if (!strcmp(argv[argi], "-d")) {
+            conninfo = argv[argi + 1];
+        } else if (!strcmp(argv[argi], "-f")) {
+            format = argv[argi + 1];
+        } else {
+            cmdPrintUsage();
+            return EXIT_FAILURE;
+        }
+        argi += 2;
+    }
+    // For compatibility, a lone argument which is not a command is the
+    // conninfo of an interactive session.
+    int subcommand = argi < argc && cmdIsSubcommand(argv[argi]);
+    if (argi < argc && !subcommand) {
+        if (argi + 1 < argc) {
+            cmdPrintUsage();
+            return EXIT_FAILURE;
+        }
+        conninfo = argv[argi];
+    }
+    // Commands are meant to be read by other programs, so they default to
+    // one JSON object per line rather than the human-readable format.
+    if (format == NULL && subcommand) {
+        format = "jsonl";
+    }
+    if (format != NULL && fmtSetFormat(format) == -1) {
+        fprintf(stderr, "Output format %s not recognized.\n", format);
+        fmtListFormats();
+        return EXIT_FAILURE;
     }
 
-    if (svn_cmdline_init("svn", stderr) != EXIT_SUCCESS) {
+    // A command which cannot run should fail before connecting. libgit2 and
+    // Subversion are only initialized once a repository is actually read.
+    if (subcommand && cmdCheckArgs(argc - argi, argv + argi) == -1) {
         return EXIT_FAILURE;
     }
     conn = pqInitConnection(conninfo);
-    git_libgit2_init();
 
-    cliRootLoop(conn);
+    int ret = EXIT_SUCCESS;
+    if (subcommand) {
+        if (cmdRun(conn, argc - argi, argv + argi) == -1) {
+            ret = EXIT_FAILURE;
+        }
+    } else {
+        cliRootLoop(conn);
+    }
 
     PQfinish(conn);
-    git_libgit2_shutdown();
+    vcsShutdown();
 
-    return EXIT_SUCCESS;
+    return ret;
 }
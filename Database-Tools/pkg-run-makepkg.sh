@@ -13,14 +13,89 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-if [ type makepkg &>/dev/null ]; then
+# Usage: pkg-run-makepkg.sh [PKGBUILD [WORKSPACE [DEST [VARIANT]]]]
+# Builds PKGBUILD (./PKGBUILD by default) in the directory WORKSPACE (./build
+# by default), which is removed afterwards, and moves the results into
+# DEST/Engines (DEST is . by default). Builds with different workspaces can
+# run at the same time.
+# VARIANT chooses the compiler flags, which the engine's build must honour:
+#   generic  portable x86-64 code (the default)
+#   native   -march=native -O3
+#   lto      native with link-time optimization
+#   pgo      native, optimized with a profile of the engine's bench command
+# Variants other than generic are stored beside it with the variant appended
+# to their names.
+# If KEEP_WORKSPACE is set, WORKSPACE is kept for the next build of the same
+# engine, which updates git sources in place and only rebuilds what changed.
+# Object files are only kept for git sources, since an extracted archive can
+# be older than the objects built from the last one. If CCACHE_DIR is set and
+# ccache is installed, C and C++ compilation goes through it.
+# If DEFER_BENCH is set, the binary's bench command is not run to measure it,
+# and bench_nps is left empty in build-info.
+
+if ! command -v makepkg >/dev/null 2>&1; then
 	echo "makepkg utility not installed."
 	exit 1
 fi
 
-# Create a temporary directory with a copy of PKGBUILD as a workspace.
-mkdir -p build && cd build
-cp ../PKGBUILD PKGBUILD
+pkgbuild=$(realpath "${1:-PKGBUILD}")
+workspace=$(realpath -m "${2:-build}")
+dest=$(realpath "${3:-.}")
+variant=${4:-generic}
+# What was built is described here for engine-db-cli, which records it.
+info="$(dirname "$pkgbuild")/build-info"
+rm -f "$info"
+
+case $variant in
+generic)
+	cflags="-march=x86-64 -mtune=generic -O2"
+	rustflags="-C target-cpu=x86-64"
+	;;
+native | pgo)
+	cflags="-march=native -O3"
+	rustflags="-C target-cpu=native"
+	;;
+lto)
+	cflags="-march=native -O3 -flto=auto"
+	rustflags="-C target-cpu=native"
+	export CARGO_PROFILE_RELEASE_LTO=true
+	;;
+*)
+	echo "Unknown variant $variant"
+	exit 1
+	;;
+esac
+
+# Create a workspace with a copy of PKGBUILD.
+mkdir -p "$workspace" && cd "$workspace"
+cp "$pkgbuild" PKGBUILD
+if [ -n "$KEEP_WORKSPACE" ] && { [ "$variant" = pgo ] || ! grep -q "git+" PKGBUILD; }; then
+	rm -rf src
+fi
+
+# The flags of the variant are added to those of the system's makepkg.conf.
+# PGO_CFLAGS and PGO_RUSTFLAGS are read when makepkg runs, so each pass of a
+# PGO build can change them.
+{
+	cat /etc/makepkg.conf 2>/dev/null
+	echo "CFLAGS=\"\$CFLAGS $cflags \$PGO_CFLAGS\""
+	echo "CXXFLAGS=\"\$CXXFLAGS $cflags \$PGO_CFLAGS\""
+	echo "LDFLAGS=\"\$LDFLAGS $cflags \$PGO_CFLAGS\""
+	echo "RUSTFLAGS=\"\$RUSTFLAGS $rustflags \$PGO_RUSTFLAGS\""
+	if [ -n "$CCACHE_DIR" ] && command -v ccache >/dev/null 2>&1; then
+		echo "BUILDENV+=(ccache)"
+	fi
+} >makepkg.conf
+export MAKEPKG_CONF="$workspace/makepkg.conf"
+
+# Prints the nodes per second the engine at $1 reports from its bench
+# command, or nothing if it has no bench command.
+bench() {
+	mkdir -p "$workspace/bench" && cd "$workspace/bench"
+	timeout 600 "$1" bench 2>&1 </dev/null |
+		grep -iE "nodes/second|nps" | grep -oE "[0-9]+" | tail -n 1
+	cd "$workspace"
+}
 
 # Download and extract files and call prepare()
 makepkg --nobuild
@@ -47,10 +122,33 @@ if [ $? != 0 ]; then
 fi
 sourcetar="$_pkgname-$_pkgver-$_pkgrel.src.tar.gz"
 
+# The same sources must give the same archive and package, byte for byte, so
+# engine-db-cli stores them once. Timestamps are those of the last commit of
+# git sources, and otherwise the epoch.
+if [ -d "src/$_pkgname/.git" ]; then
+	SOURCE_DATE_EPOCH=$(git -C "src/$_pkgname" log -1 --format=%ct)
+	export SOURCE_DATE_EPOCH
+fi
+epoch=${SOURCE_DATE_EPOCH:-0}
+
 # Archive then compress the source files
 # find "src/$_pkgname" -path "src/$_pkgname/.git" -prune -o -print |
+# A kept git tree holds the objects of the last build, so only what git tracks
+# is archived, including the changes prepare() made to it.
 cd src
-tar cfz "$sourcetar" --exclude-vcs --exclude-vcs-ignores "$_pkgname"
+if [ -n "$KEEP_WORKSPACE" ] && [ -d "$_pkgname/.git" ]; then
+	tree=$(GIT_AUTHOR_NAME=makepkg GIT_AUTHOR_EMAIL=makepkg \
+		GIT_COMMITTER_NAME=makepkg GIT_COMMITTER_EMAIL=makepkg \
+		GIT_AUTHOR_DATE="@$epoch" GIT_COMMITTER_DATE="@$epoch" \
+		git -C "$_pkgname" stash create)
+	git -C "$_pkgname" archive --format=tar --prefix="$_pkgname/" \
+		-o "../${sourcetar%.gz}" "${tree:-HEAD}" &&
+		gzip -nf "${sourcetar%.gz}"
+else
+	tar cf "${sourcetar%.gz}" --sort=name --mtime="@$epoch" --owner=0 \
+		--group=0 --numeric-owner --exclude-vcs --exclude-vcs-ignores \
+		"$_pkgname" && gzip -nf "${sourcetar%.gz}"
+fi
 if [ $? != 0 ]; then
 	echo "tar failed to archive files without modification"
 	exit 3
@@ -58,20 +156,86 @@ fi
 mv "$sourcetar" "../$sourcetar"
 cd ..
 
+# A PGO build is built once instrumented, trained by running bench, and built
+# again from freshly extracted sources with the profile it wrote. GCC writes
+# .gcda files beside its own profile, while clang writes .profraw files which
+# are merged with Rust's, so the flags depend on the C compiler.
+if [ "$variant" = pgo ]; then
+	profile="$workspace/profile"
+	rm -rf "$profile"
+	mkdir -p "$profile"
+	cc_clang=""
+	if ${CC:-cc} --version 2>/dev/null | grep -q clang; then
+		cc_clang=1
+		cc_generate="-fprofile-instr-generate=$profile/cc-%p.profraw"
+		cc_use="-fprofile-instr-use=$profile/merged.profdata -Wno-profile-instr-unprofiled -Wno-profile-instr-out-of-date"
+	else
+		cc_generate="-fprofile-generate=$profile"
+		cc_use="-fprofile-use=$profile -fprofile-partial-training -Wno-missing-profile"
+	fi
+	PGO_CFLAGS="$cc_generate" \
+		PGO_RUSTFLAGS="-C profile-generate=$profile" makepkg --noextract
+	if [ $? != 0 ]; then
+		echo "makepkg failed to build the instrumented sources"
+		exit 1
+	fi
+	bench "$workspace/pkg/$_pkgname/usr/bin/$_pkgname" >/dev/null
+	if ls "$profile"/*.profraw >/dev/null 2>&1; then
+		llvm-profdata merge -o "$profile/merged.profdata" "$profile"/*.profraw
+	fi
+	# The instrumented objects would otherwise be taken as up to date.
+	rm -rf src
+	makepkg --nobuild --force
+	export PGO_CFLAGS="$cc_use"
+	export PGO_RUSTFLAGS="-C profile-use=$profile/merged.profdata"
+	if [ ! -f "$profile/merged.profdata" ]; then
+		PGO_RUSTFLAGS=""
+		if [ -n "$cc_clang" ]; then
+			PGO_CFLAGS=""
+		fi
+	fi
+fi
+
 # Build the package extracted by the previous step
-makepkg --noextract
+makepkg --noextract --force
 if [ $? != 0 ]; then
 	echo "makepkg failed to build the extracted sources"
 	exit 1
 fi
+# A build sharing the machine with others cannot measure the binary fairly,
+# so with DEFER_BENCH set that is left to whoever runs the script.
+if [ -z "$DEFER_BENCH" ]; then
+	nps=$(bench "$workspace/pkg/$_pkgname/usr/bin/$_pkgname")
+fi
 
 # Clean up, moving the package, the source tarball, and
 # the pkgbuild tarball to a dedicated directory
-cp PKGBUILD ../PKGBUILD
-cd ..
+if [ "$variant" = generic ]; then
+	suffix=""
+else
+	suffix="-$variant"
+fi
+cp PKGBUILD "$pkgbuild"
+cd "$dest"
 mkdir -p "Engines/$_pkgname" "Engines/share/$_pkgname"
-mv "build/pkg/$_pkgname/usr/bin/$_pkgname" "Engines/$_pkgname/$_pkgname-$_pkgver"
-mv "build/pkg/$_pkgname/usr/share/$_pkgname"/* "Engines/share/$_pkgname"
-mv "build/$_pkgname-$_pkgver-$_pkgrel-x86_64.pkg.tar.zst" "Engines/$_pkgname/"
-mv "build/$sourcetar" "Engines/$_pkgname/"
-rm -rf build
+mv -f "$workspace/pkg/$_pkgname/usr/bin/$_pkgname" "Engines/$_pkgname/$_pkgname-$_pkgver$suffix"
+mv -f "$workspace/pkg/$_pkgname/usr/share/$_pkgname"/* "Engines/share/$_pkgname"
+mv -f "$workspace/$_pkgname-$_pkgver-$_pkgrel-x86_64.pkg.tar.zst" "Engines/$_pkgname/$_pkgname-$_pkgver-$_pkgrel$suffix-x86_64.pkg.tar.zst"
+mv -f "$workspace/$sourcetar" "Engines/$_pkgname/"
+if [ -z "$KEEP_WORKSPACE" ]; then
+	rm -rf "$workspace"
+fi
+
+if grep -q "cargo" "$pkgbuild"; then
+	compiler=$(rustc --version 2>/dev/null)
+else
+	compiler=$(${CC:-cc} --version 2>/dev/null | head -n 1)
+fi
+{
+	echo "binary=$dest/Engines/$_pkgname/$_pkgname-$_pkgver$suffix"
+	echo "compiler=$compiler"
+	echo "bench_nps=$nps"
+	echo "artifact=$dest/Engines/$_pkgname/$_pkgname-$_pkgver$suffix"
+	echo "artifact=$dest/Engines/$_pkgname/$_pkgname-$_pkgver-$_pkgrel$suffix-x86_64.pkg.tar.zst"
+	echo "artifact=$dest/Engines/$_pkgname/$sourcetar"
+} >"$info"
@@ -45,9 +45,13 @@ char* pkgAllocStringFromFile() {
 }
 
 size_t pkgStoreStringToFile(char* pkgbuild) {
-    FILE* fp = fopen("PKGBUILD", "wb");
+    return pkgStoreStringToPath(pkgbuild, "PKGBUILD");
+}
+
+size_t pkgStoreStringToPath(const char* pkgbuild, const char* path) {
+    FILE* fp = fopen(path, "wb");
     if (!fp) {
-        fprintf(stderr, "Creation or opening of PKGBUILD file failed.");
+        fprintf(stderr, "Creation or opening of %s failed.\n", path);
         return 0;
     }
     size_t bytes = fwrite(pkgbuild, sizeof(char), strlen(pkgbuild), fp);
@@ -97,27 +101,22 @@ size_t pkgCreateDefaultFile(char* engine_name, char* version_name, char* note,
         }
     }
 
+    // Every piece of the file is only needed until it is written, so they
+    // are all allocated together and freed in one go.
+    arena pieces;
+    arenaInit(&pieces, 4096);
+
     char* name_buf;
-    int   name_len = 0;
     // If the version is based on a branch head, then label it with the vcs.
     if (!strcmp(frag_type, "branch")) {
-        name_len = snprintf(NULL, 0, name_fmt, engine_name, "-", vcs_name);
-        name_buf = errhandMalloc(name_len + 1);
-        snprintf(name_buf, name_len + 1, name_fmt, engine_name, "-", vcs_name);
+        name_buf = arenaSprintf(&pieces, name_fmt, engine_name, "-", vcs_name);
     } else {
-        name_len = snprintf(NULL, 0, name_fmt, engine_name, "", "");
-        name_buf = errhandMalloc(name_len + 1);
-        snprintf(name_buf, name_len + 1, name_fmt, engine_name, "", "");
+        name_buf = arenaSprintf(&pieces, name_fmt, engine_name, "", "");
     }
 
-    char* frag_buf;
+    char* frag_buf = "";
     if (frag_val[0] != '\0') {
-        int frag_len = snprintf(NULL, 0, frag_fmt, frag_type, frag_val);
-        frag_buf = errhandMalloc(frag_len + 1);
-        snprintf(frag_buf, frag_len + 1, frag_fmt, frag_type, frag_val);
-    } else {
-        frag_buf = errhandMalloc(1);
-        frag_buf[0] = '\0';
+        frag_buf = arenaSprintf(&pieces, frag_fmt, frag_type, frag_val);
     }
 
     // PKGBUILD is making a transition to SPDX identifiers, see
@@ -125,16 +124,12 @@ size_t pkgCreateDefaultFile(char* engine_name, char* version_name, char* note,
     // This simplifies my life a lot actually.
     char* license_buf;
     if (!strncmp(license, "Custom", 6)) {
-        int license_len = snprintf(NULL, 0, "'custom:%s-license'", engine_name);
-        license_buf = errhandMalloc(license_len + 1);
-        snprintf(license_buf, license_len + 1, "'custom:%s-license'",
-                 engine_name);
+        license_buf =
+            arenaSprintf(&pieces, "'custom:%s-license'", engine_name);
     } else if (!strncmp(license, "None", 4)) {
-        license_buf = errhandStrdup("");
+        license_buf = "";
     } else {
-        int license_len = snprintf(NULL, 0, "'%s'", license);
-        license_buf = errhandMalloc(license_len + 1);
-        snprintf(license_buf, license_len + 1, "'%s'", license);
+        license_buf = arenaSprintf(&pieces, "'%s'", license);
     }
 
     char* dep_buf;
@@ -142,63 +137,104 @@ size_t pkgCreateDefaultFile(char* engine_name, char* version_name, char* note,
     // Handles any dependencies based on the programming language.
     // TODO: The rest of the programming languages.
     if (!strcmp(code_lang_name, "C") || !strcmp(code_lang_name, "C++")) {
-        dep_buf = errhandStrdup("'glibc'");
-        makedep_buf = errhandStrdup("");
+        dep_buf = "'glibc'";
+        makedep_buf = "";
     } else if (!strncmp(code_lang_name, "Rust", 4)) {
-        dep_buf = errhandStrdup("");
-        makedep_buf = errhandStrdup("'cargo'");
+        dep_buf = "";
+        makedep_buf = "'cargo'";
     } else {
-        dep_buf = errhandStrdup("");
-        makedep_buf = errhandStrdup("");
+        dep_buf = "";
+        makedep_buf = "";
     }
 
     char* source_buf;
     // Handles dependencies based on the version control system.
     if (!strncmp(vcs_name, "git", 3)) {
-        int source_len =
-            snprintf(NULL, 0, source_fmt, vcs_name, ".git", frag_buf);
-        source_buf = errhandMalloc(source_len + 1);
-        snprintf(source_buf, source_len + 1, source_fmt, vcs_name, ".git",
-                 frag_buf);
-
-        if (strlen(makedep_buf)) {
-            makedep_buf = errhandRealloc(makedep_buf, 2 + strlen(makedep_buf));
-            strcat(makedep_buf, " ");
-        }
-        makedep_buf = errhandRealloc(makedep_buf, 6 + strlen(makedep_buf));
-        makedep_buf = strcat(makedep_buf, "'git'");
+        source_buf =
+            arenaSprintf(&pieces, source_fmt, vcs_name, ".git", frag_buf);
+        makedep_buf = arenaSprintf(&pieces, "%s%s'git'", makedep_buf,
+                                   strlen(makedep_buf) ? " " : "");
     } else if (!strncmp(vcs_name, "svn", 3)) {
-        int source_len = snprintf(NULL, 0, source_fmt, vcs_name, "", frag_buf);
-        source_buf = errhandMalloc(source_len + 1);
-        snprintf(source_buf, source_len + 1, source_fmt, vcs_name, "",
-                 frag_buf);
-
-        if (strlen(makedep_buf)) {
-            makedep_buf = errhandRealloc(makedep_buf, 2 + strlen(makedep_buf));
-            strcat(makedep_buf, " ");
-        }
-        makedep_buf = errhandRealloc(makedep_buf, 13 + strlen(makedep_buf));
-        makedep_buf = strcat(makedep_buf, "'subversion'");
+        source_buf = arenaSprintf(&pieces, source_fmt, vcs_name, "", frag_buf);
+        makedep_buf = arenaSprintf(&pieces, "%s%s'subversion'", makedep_buf,
+                                   strlen(makedep_buf) ? " " : "");
     } else {
-        source_buf = errhandStrdup(uri);
+        source_buf = uri;
     }
 
-    int pkg_len = snprintf(NULL, 0, pkg_fmt, name_buf, version_name, note, uri,
-                           license_buf, dep_buf, makedep_buf, source_buf);
-    char* pkg_buf = errhandMalloc(pkg_len + 1);
-    snprintf(pkg_buf, pkg_len + 1, pkg_fmt, name_buf, version_name, note, uri,
-             license_buf, dep_buf, makedep_buf, source_buf);
+    char* pkg_buf =
+        arenaSprintf(&pieces, pkg_fmt, name_buf, version_name, note, uri,
+                     license_buf, dep_buf, makedep_buf, source_buf);
 
     size_t ret = pkgStoreStringToFile(pkg_buf);
-    free(name_buf);
-    free(license_buf);
-    free(dep_buf);
-    free(makedep_buf);
-    free(source_buf);
-    free(frag_buf);
-    free(pkg_buf);
+    arenaFree(&pieces);
 
     return ret;
 }
 
-int pkgRunMakepkg() { return system("./pkg-run-makepkg.sh"); }
+// Returns a copy of pkgbuild with the body of function name replaced by body,
+// which must end in a newline, or NULL if the body is not the placeholder
+// pkgCreateDefaultFile writes, so that no hand-written function is lost.
+char* pkgAllocWithFunction(const char* pkgbuild, const char* name,
+                           const char* body) {
+    char stub[64];
+    snprintf(stub, sizeof(stub), "%s() {\n  :\n}", name);
+    const char* at = strstr(pkgbuild, stub);
+    while (at != NULL && at != pkgbuild && at[-1] != '\n') {
+        at = strstr(at + 1, stub);
+    }
+    if (at == NULL) {
+        return NULL;
+    }
+    // Everything through the opening brace is kept, as is the closing brace.
+    size_t head = at - pkgbuild + strlen(name) + 5;
+    char*  tail = (char*)at + strlen(stub) - 1;
+    char*  out = errhandMalloc(head + strlen(body) + strlen(tail) + 1);
+    memcpy(out, pkgbuild, head);
+    strcpy(out + head, body);
+    strcat(out + head, tail);
+
+    return out;
+}
+
+// Returns a copy of pkgbuild with every word of deps, a space separated list
+// of quoted package names, added to the array named array unless it is there
+// already. Returns NULL if pkgbuild has no such array.
+char* pkgAllocWithDepends(const char* pkgbuild, const char* array,
+                          const char* deps) {
+    char start[32];
+    snprintf(start, sizeof(start), "%s=(", array);
+    const char* at = strstr(pkgbuild, start);
+    while (at != NULL && at != pkgbuild && at[-1] != '\n') {
+        at = strstr(at + 1, start);
+    }
+    const char* close = at == NULL ? NULL : strchr(at, ')');
+    if (close == NULL) {
+        return NULL;
+    }
+    const char* open = at + strlen(start);
+    char*       out = errhandMalloc(strlen(pkgbuild) + strlen(deps) + 2);
+    size_t      len = close - pkgbuild;
+    memcpy(out, pkgbuild, len);
+
+    const char* dep = deps;
+    while (*dep != '\0') {
+        size_t dep_len = strcspn(dep, " ");
+        int    found = 0;
+        for (const char* p = open; p + dep_len <= close && !found; p++) {
+            found = !strncmp(p, dep, dep_len);
+        }
+        if (!found && dep_len > 0) {
+            if (out[len - 1] != '(') {
+                out[len++] = ' ';
+            }
+            memcpy(out + len, dep, dep_len);
+            len += dep_len;
+        }
+        dep += dep_len;
+        dep += strspn(dep, " ");
+    }
+    strcpy(out + len, close);
+
+    return out;
+}
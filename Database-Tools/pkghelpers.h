@@ -21,10 +21,14 @@ limitations under the License.
 
 extern char*  pkgAllocStringFromFile();
 extern size_t pkgStoreStringToFile(char* pkgbuild);
+extern size_t pkgStoreStringToPath(const char* pkgbuild, const char* path);
 extern size_t pkgCreateDefaultFile(char* engine_name, char* version_name,
                                    char* note, char* uri, char* license,
                                    char* vcs_name, char* code_lang_name,
                                    char* frag_type, char* frag_val);
-extern int    pkgRunMakepkg();
+extern char*  pkgAllocWithFunction(const char* pkgbuild, const char* name,
+                                   const char* body);
+extern char*  pkgAllocWithDepends(const char* pkgbuild, const char* array,
+                                  const char* deps);
 
 #endif
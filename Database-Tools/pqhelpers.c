@@ -15,60 +15,87 @@ limitations under the License.
 */
 
 #include "pqhelpers.h"
+#include "cachehelpers.h"
+#include "fmthelpers.h"
 #include "globals.h"
+#include "hashhelpers.h"
+#include "iohelpers.h"
 #include "pkghelpers.h"
+#include <arpa/inet.h>
 #include <libpq-fe.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <zlib.h>
+
+// Returns the options conninfo gives, or else those in PGOPTIONS, or NULL if
+// there are none. Must be freed.
+static char* pqAllocUserOptions(const char* conninfo) {
+    char*             options = NULL;
+    PQconninfoOption* parsed = PQconninfoParse(conninfo, NULL);
+    // A bare database name is not a conninfo string, and gives no options.
+    if (parsed != NULL) {
+        for (PQconninfoOption* opt = parsed; opt->keyword != NULL; opt++) {
+            if (!strcmp(opt->keyword, "options") && opt->val != NULL) {
+                options = errhandStrdup(opt->val);
+            }
+        }
+        PQconninfoFree(parsed);
+    }
+    // Options given here override PGOPTIONS, so those are kept by hand too.
+    const char* env = getenv("PGOPTIONS");
+    if (options == NULL && env != NULL) {
+        options = errhandStrdup(env);
+    }
+    return options;
+}
 
 PGconn* pqInitConnection(const char* conninfo) {
-    PGconn* conn = PQconnectdb(conninfo);
+    // Set an always-secure search path, so malicious users can't take
+    // control, with the schema set to engine to match the creation file.
+    // The example at https://www.postgresql.org/docs/15/libpq-example.html
+    // sets it with a query after connecting. Passing it as a startup option
+    // instead saves that round trip. conninfo is expanded into the other
+    // keywords, and any options it gives are kept ahead of this one.
+    char* user_options = pqAllocUserOptions(conninfo);
+    char* options =
+        errhandMalloc((user_options ? strlen(user_options) : 0) + 32);
+    sprintf(options, "%s%s-c search_path=engine",
+            user_options ? user_options : "", user_options ? " " : "");
+    free(user_options);
+    const char* const keywords[] = {"dbname", "options", NULL};
+    const char* const values[] = {conninfo, options, NULL};
+
+    PGconn* conn = PQconnectdbParams(keywords, values, 1);
+    free(options);
     if (PQstatus(conn) != CONNECTION_OK) {
         fprintf(stderr, "%s", PQerrorMessage(conn));
         PQfinish(conn);
         exit(1);
     }
 
-    // Set always-secure search path, so malicious users can't take control.
-    // Recommended code from
-    // https://www.postgresql.org/docs/15/libpq-example.html
-    PGresult* res =
-        PQexec(conn, "SELECT pg_catalog.set_config('search_path', '', false)");
-    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
-        PQclear(res);
-        PQfinish(conn);
-        exit(2);
-    }
-    PQclear(res);
-
-    // Set schema to engines to match the creation file
-    res = PQexec(conn, "SET search_path TO engine;");
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        fprintf(stderr, "SET failed: %s", PQerrorMessage(conn));
-        PQclear(res);
-        PQfinish(conn);
-        exit(1);
-    }
-    PQclear(res);
-
     return conn;
 }
 
 // If calling this function, it is assumed the result of the look-up
 // was successful and res contains table data.
-void pqPrintTable(PGresult* res) {
-    // Print the table in a format similar to JSON or Rust's debug print
-    printf("[");
-    for (int i = 0; i < PQntuples(res); i += 1) {
-        printf("\n");
-        for (int j = 0; j < PQnfields(res); j += 1) {
-            printf("  %-15s: %s\n", PQfname(res, j), PQgetvalue(res, i, j));
-        }
-    }
-    printf("]\n");
+void pqPrintTable(PGresult* res) { fmtPrintResult(res); }
+
+// Reads an int4 column of a result requested in binary format, which the
+// server sends in network byte order, so no text needs to be parsed.
+int pqGetIntValue(const PGresult* res, int row, int col) {
+    uint32_t value;
+    memcpy(&value, PQgetvalue(res, row, col), sizeof(value));
+    return (int32_t)ntohl(value);
+}
+
+// Reads a date column of a result requested in binary format, which the
+// server sends as the number of days since 2000-01-01. Returns the number of
+// days since 1970-01-01.
+int pqGetDateValue(const PGresult* res, int row, int col) {
+    return pqGetIntValue(res, row, col) + PQ_EPOCH_DAYS_2000;
 }
 
 void pqListEngines(PGconn* conn) {
@@ -91,7 +118,7 @@ int* pqAllocEngineIdsWithName(PGconn* conn, char* engine_name) {
     PGresult* res = PQexecParams(conn,
                                  "SELECT engine_id FROM engine "
                                  "WHERE engine_name = $1;",
-                                 1, NULL, paramValues, NULL, NULL, 0);
+                                 1, NULL, paramValues, NULL, NULL, 1);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -102,7 +129,7 @@ int* pqAllocEngineIdsWithName(PGconn* conn, char* engine_name) {
     int* results = (int*)errhandMalloc((PQntuples(res) + 1) * sizeof(int));
     results[0] = PQntuples(res);
     for (int i = 0; i < *(results); i += 1) {
-        results[i + 1] = atoi(PQgetvalue(res, i, 0));
+        results[i + 1] = pqGetIntValue(res, i, 0);
     }
 
     PQclear(res);
@@ -134,6 +161,49 @@ char* pqAllocVersionIdWithName(PGconn* conn, char* engine_id,
     return NULL;
 }
 
+// Finds up to 10 engines whose names are similar to or start with pattern, or
+// whose notes contain words similar to pattern, best matches first.
+// Note: The caller is responsible for checking the query was successful and for
+// freeing res.
+PGresult* pqAllocEngineMatches(PGconn* conn, char* pattern) {
+    // Escape the LIKE wildcards in pattern, so it is only used as a prefix.
+    char* prefix = errhandMalloc(2 * strlen(pattern) + 2);
+    char* p = prefix;
+    for (char* c = pattern; *c; c++) {
+        if (*c == '\\' || *c == '%' || *c == '_') {
+            *p++ = '\\';
+        }
+        *p++ = *c;
+    }
+    strcpy(p, "%");
+    const char* paramValues[2] = {pattern, prefix};
+
+    PGresult* res = PQexecParams(
+        conn,
+        "SELECT engine_id, engine_name, note, round(greatest("
+        "similarity(engine_name, $1), word_similarity($1, note))::numeric, 2) "
+        "AS score FROM engine "
+        "WHERE engine_name % $1 OR engine_name ILIKE $2 OR $1 <% note "
+        "ORDER BY lower(engine_name) = lower($1) DESC, "
+        "engine_name ILIKE $2 DESC, similarity(engine_name, $1) DESC, "
+        "word_similarity($1, note) DESC, engine_name ASC LIMIT 10;",
+        2, NULL, paramValues, NULL, NULL, 0);
+    free(prefix);
+    return res;
+}
+
+void pqListEngineMatches(PGconn* conn, char* pattern) {
+    PGresult* res = pqAllocEngineMatches(conn, pattern);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return;
+    }
+    pqPrintTable(res);
+
+    PQclear(res);
+}
+
 void pqListEnginesWithName(PGconn* conn, char* engine_name) {
     const char* paramValues[1] = {engine_name};
 
@@ -158,10 +228,10 @@ void pqListEnginesWithName(PGconn* conn, char* engine_name) {
 void pqListNote(PGconn* conn, char* engine_id) {
     const char* paramValues[1] = {engine_id};
 
-    PGresult* res = PQexecParams(conn,
-                                 "SELECT note FROM engine "
-                                 "WHERE engine_id = $1;",
-                                 1, NULL, paramValues, NULL, NULL, 0);
+    PGresult* res = cacheExecParams(conn,
+                                    "SELECT note FROM engine "
+                                    "WHERE engine_id = $1;",
+                                    1, paramValues);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -175,11 +245,11 @@ void pqListNote(PGconn* conn, char* engine_id) {
 void pqListAuthors(PGconn* conn, char* engine_id) {
     const char* paramValues[1] = {engine_id};
 
-    PGresult* res = PQexecParams(
+    PGresult* res = cacheExecParams(
         conn,
         "SELECT author_name FROM author "
         "JOIN engine_author USING (author_id) WHERE engine_id = $1",
-        1, NULL, paramValues, NULL, NULL, 0);
+        1, paramValues);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -193,11 +263,11 @@ void pqListAuthors(PGconn* conn, char* engine_id) {
 void pqListSources(PGconn* conn, char* engine_id) {
     const char* paramValues[1] = {engine_id};
 
-    PGresult* res = PQexecParams(
+    PGresult* res = cacheExecParams(
         conn,
         "SELECT source_uri, vcs_name FROM source JOIN vcs USING (vcs_id) "
         "JOIN engine_source USING (source_id) WHERE engine_id = $1",
-        1, NULL, paramValues, NULL, NULL, 0);
+        1, paramValues);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -224,7 +294,7 @@ void pqListVersions(PGconn* conn, char* engine_id) {
     that the database can treat solely as data, see
     https://www.crunchydata.com/blog/preventing-sql-injection-attacks-in-postgresql
     */
-    PGresult* res = PQexecParams(
+    PGresult* res = cacheExecParams(
         conn,
         "SELECT version_name, source_uri, frag_type, frag_val, release_date, "
         "code_lang_name, license_name, is_xboard, is_uci, v.note "
@@ -232,7 +302,7 @@ void pqListVersions(PGconn* conn, char* engine_id) {
         "JOIN source USING (source_id) JOIN engine USING (engine_id) "
         "JOIN license USING (license_id) JOIN code_lang USING (code_lang_id) "
         "WHERE v.engine_id = $1 ORDER BY release_date DESC;",
-        1, NULL, paramValues, NULL, NULL, 0);
+        1, paramValues);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -246,39 +316,103 @@ void pqListVersions(PGconn* conn, char* engine_id) {
 void pqListVersionDetails(PGconn* conn, char* version_id) {
     const char* paramValues[1] = {version_id};
 
-    PGresult* res = PQexecParams(
+    fmtBeginDocument();
+    fmtNameTable("version");
+
+    PGresult* res = cacheExecParams(
         conn,
         "SELECT version_name, source_uri, frag_type, frag_val, release_date, "
         "code_lang_name, license_name, is_xboard, is_uci, note FROM version v "
         "JOIN revision USING (revision_id) JOIN source USING (source_id) "
         "JOIN license USING (license_id) JOIN code_lang USING (code_lang_id) "
         "WHERE version_id = $1 ORDER BY release_date DESC;",
-        1, NULL, paramValues, NULL, NULL, 0);
+        1, paramValues);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
+        fmtEndDocument();
         return;
     }
     pqPrintTable(res);
     PQclear(res);
 
-    res = PQexecParams(conn,
-                       "SELECT os_name FROM version_os JOIN os USING (os_id) "
-                       "WHERE version_id = $1;",
-                       1, NULL, paramValues, NULL, NULL, 0);
+    fmtNameTable("os");
+    res = cacheExecParams(
+        conn,
+        "SELECT os_name FROM version_os JOIN os USING (os_id) "
+        "WHERE version_id = $1;",
+        1, paramValues);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
+        fmtEndDocument();
         return;
     }
     pqPrintTable(res);
     PQclear(res);
 
-    res = PQexecParams(
+    fmtNameTable("egtb");
+    res = cacheExecParams(
         conn,
         "SELECT egtb_name FROM version_egtb JOIN egtb USING (egtb_id) "
         "WHERE version_id = $1;",
-        1, NULL, paramValues, NULL, NULL, 0);
+        1, paramValues);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        fmtEndDocument();
+        return;
+    }
+    pqPrintTable(res);
+    PQclear(res);
+    fmtEndDocument();
+}
+
+// Prints the note, authors, sources and versions of engine_id as one document.
+void pqListEngineDetails(PGconn* conn, char* engine_id) {
+    fmtBeginDocument();
+    fmtNameTable("note");
+    pqListNote(conn, engine_id);
+    fmtNameTable("authors");
+    pqListAuthors(conn, engine_id);
+    fmtNameTable("sources");
+    pqListSources(conn, engine_id);
+    fmtNameTable("versions");
+    pqListVersions(conn, engine_id);
+    fmtEndDocument();
+}
+
+// Prints the engines engine_id derives from, or the engines derived from it if
+// descendants is nonzero, nearest first. This walks the relations on the
+// server, and is used when the in-memory lineage graph is unavailable.
+void pqListLineage(PGconn* conn, char* engine_id, int descendants) {
+    const char* paramValues[1] = {engine_id};
+
+    // near_id is the engine a step starts from, and far_id the engine it
+    // reaches, so swapping the columns reverses the direction of the walk.
+    const char* columns =
+        descendants ? "origin_engine_id AS near_id, engine_id AS far_id"
+                    : "engine_id AS near_id, origin_engine_id AS far_id";
+    // No simple path is longer than the number of engines, so limiting the
+    // depth to it ends the recursion even if the relations form a cycle.
+    char query[1024];
+    snprintf(query, 1024,
+             "WITH RECURSIVE link AS ("
+             "SELECT %s, 'predecessor' AS relation FROM predecessor "
+             "UNION ALL SELECT %s, 'inspiration' FROM inspiration), "
+             "walk AS (SELECT far_id AS engine_id, relation, 1 AS depth "
+             "FROM link WHERE near_id = $1 "
+             "UNION SELECT l.far_id, l.relation, w.depth + 1 "
+             "FROM walk w JOIN link l ON l.near_id = w.engine_id "
+             "WHERE w.depth < (SELECT count(*) FROM engine)) "
+             "SELECT engine_id, engine_name, relation, depth FROM ("
+             "SELECT DISTINCT ON (engine_id) * FROM walk "
+             "WHERE engine_id <> $1 ORDER BY engine_id, depth, relation DESC"
+             ") w JOIN engine USING (engine_id) ORDER BY depth, engine_id;",
+             columns, columns);
+
+    PGresult* res = PQexecParams(conn, query, 1, NULL, paramValues, NULL,
+                                 NULL, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -288,27 +422,44 @@ void pqListVersionDetails(PGconn* conn, char* version_id) {
     PQclear(res);
 }
 
+// Returns the release date of the latest version of an engine, or NULL if the
+// engine has no versions or the look-up failed. Must be freed.
 char* pqAllocLatestVersionDate(PGconn* conn, char* engine_id) {
     const char* paramValues[1] = {engine_id};
 
-    PGresult* res = PQexecParams(
-        conn,
-        "SELECT release_date FROM version v JOIN engine USING (engine_id) "
-        "JOIN license USING (license_id) "
-        "JOIN code_lang USING (code_lang_id) WHERE v.engine_id = $1 "
-        "ORDER BY release_date DESC LIMIT 1;",
-        1, NULL, paramValues, NULL, NULL, 0);
+    PGresult* res = PQexecParams(conn,
+                                 "SELECT release_date FROM latest_version "
+                                 "WHERE engine_id = $1;",
+                                 1, NULL, paramValues, NULL, NULL, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
         return NULL;
     }
+    if (!PQntuples(res)) {
+        PQclear(res);
+        return NULL;
+    }
     char* ret = errhandStrdup(PQgetvalue(res, 0, 0));
 
     PQclear(res);
     return ret;
 }
 
+// Rebuilds the latest_version summary from scratch.
+// Returns 0 on success, and -1 on failure.
+int pqRefreshLatestVersions(PGconn* conn) {
+    PGresult* res = PQexec(conn, "SELECT refresh_latest_version();");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+
+    PQclear(res);
+    return 0;
+}
+
 // Returns the engine_id of the engine just inserted on success, NULL on
 // failure.
 char* pqInsertEngine(PGconn* conn, char* engine_name, char* note) {
@@ -349,7 +500,7 @@ int pqGetElementId(PGconn* conn, char* element, const char** literals,
     const char* select_query = query_maker;
 
     PGresult* res =
-        PQexecParams(conn, select_query, 1, NULL, paramValues, NULL, NULL, 0);
+        PQexecParams(conn, select_query, 1, NULL, paramValues, NULL, NULL, 1);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -357,7 +508,7 @@ int pqGetElementId(PGconn* conn, char* element, const char** literals,
     }
     int ret = -1;
     if (PQntuples(res)) {
-        ret = atoi(PQgetvalue(res, 0, 0));
+        ret = pqGetIntValue(res, 0, 0);
         PQclear(res);
         return ret;
     }
@@ -371,13 +522,13 @@ int pqGetElementId(PGconn* conn, char* element, const char** literals,
              literals[2], literals[1]);
     const char* insert_query = query_maker;
 
-    res = PQexecParams(conn, insert_query, 1, NULL, paramValues, NULL, NULL, 0);
+    res = PQexecParams(conn, insert_query, 1, NULL, paramValues, NULL, NULL, 1);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "INSERT failed: %s", PQerrorMessage(conn));
         PQclear(res);
         return -1;
     }
-    ret = atoi(PQgetvalue(res, 0, 0));
+    ret = pqGetIntValue(res, 0, 0);
 
     PQclear(res);
     return ret;
@@ -441,14 +592,14 @@ int pqInsertSource(PGconn* conn, char* engine_id, code_link source) {
         PQexecParams(conn,
                      "INSERT INTO source (source_uri, vcs_id)"
                      "VALUES ($1, $2) RETURNING source_id;",
-                     2, NULL, sourceParamValues, NULL, NULL, 0);
+                     2, NULL, sourceParamValues, NULL, NULL, 1);
     if (PQresultStatus(res_source) != PGRES_TUPLES_OK) {
         fprintf(stderr, "INSERT failed: %s", PQerrorMessage(conn));
         PQclear(res_vcs);
         PQclear(res_source);
         return -1;
     }
-    int source_id = atoi(PQgetvalue(res_source, 0, 0));
+    int source_id = pqGetIntValue(res_source, 0, 0);
 
     const char* literals[2] = {"engine_source", "source"};
     int         ret = pqAddRelation(conn, engine_id, source_id, literals);
@@ -536,13 +687,13 @@ int pqInsertRevision(PGconn* conn, revision rev_info) {
         PQexecParams(conn,
                      "INSERT INTO revision (source_id, frag_type, frag_val)"
                      "VALUES ($1, $2, $3) RETURNING revision_id;",
-                     3, NULL, paramValues, NULL, NULL, 0);
+                     3, NULL, paramValues, NULL, NULL, 1);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "INSERT failed: %s\n", PQerrorMessage(conn));
         PQclear(res);
         return -1;
     }
-    int ret = atoi(PQgetvalue(res, 0, 0));
+    int ret = pqGetIntValue(res, 0, 0);
 
     PQclear(res);
     return ret;
@@ -611,15 +762,22 @@ int pqInsertVersionEgtb(PGconn* conn, char* version_id, char* egtb_name) {
     return 0;
 }
 
+// Each row also holds the release date of the engine's latest version.
 // Note: The caller is responsible for checking the query was successful and for
 // freeing res.
+// The result is in binary format, so the id and date columns must be read with
+// pqGetIntValue and pqGetDateValue. The text columns are unaffected, since
+// text is sent as is in either format.
 PGresult* pqAllocAllBranchRevisions(PGconn* conn) {
-    PGresult* res = PQexec(
+    PGresult* res = PQexecParams(
         conn,
         "SELECT revision_id, source_uri, frag_type, frag_val, vcs_name, "
-        "engine_id, source_id FROM revision JOIN source USING (source_id) "
-        "JOIN vcs USING (vcs_id) JOIN engine_source USING (source_id) "
-        "JOIN engine USING (engine_id) WHERE frag_type = 'branch';");
+        "engine_id, source_id, release_date FROM revision "
+        "JOIN source USING (source_id) JOIN vcs USING (vcs_id) "
+        "JOIN engine_source USING (source_id) JOIN engine USING (engine_id) "
+        "LEFT JOIN latest_version USING (engine_id) "
+        "WHERE frag_type = 'branch';",
+        0, NULL, NULL, NULL, NULL, 1);
     return res;
 }
 
@@ -703,14 +861,35 @@ revision* pqAllocRevisionFromVersion(PGconn* conn, char* version_id) {
     return rev;
 }
 
-// Returns 0 on success of creating the table, and -1 on failure
+// Returns 0 on success of creating the table, and -1 on failure, including
+// when another scan holds the table.
+// The table is kept after the scan, so the versions it found outdated can be
+// rebuilt, and is replaced by the next scan. Replacing it takes an advisory
+// lock held until pqUnlockUpdateTable or the connection closes, so a second
+// scan fails rather than dropping the table out from under a running one.
 int pqCreateUpdateTable(PGconn* conn) {
-    PGresult* res =
-        PQexec(conn, "CREATE TABLE update "
-                     "(revision_id int REFERENCES revision (revision_id));");
+    PGresult* res = PQexec(
+        conn, "SELECT pg_try_advisory_lock(hashtext('engine.update'));");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    if (strcmp(PQgetvalue(res, 0, 0), "t")) {
+        fprintf(stderr, "Another update scan is running.\n");
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+
+    // Deleting a revision deletes its row here too, rather than being refused.
+    res = PQexec(conn, "DROP TABLE IF EXISTS update; CREATE TABLE update "
+                       "(revision_id int REFERENCES revision (revision_id) "
+                       "ON DELETE CASCADE);");
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "CREATE TABLE failed: %s", PQerrorMessage(conn));
         PQclear(res);
+        pqUnlockUpdateTable(conn);
         return -1;
     }
 
@@ -718,14 +897,26 @@ int pqCreateUpdateTable(PGconn* conn) {
     return 0;
 }
 
+// Lets the next scan replace the update table.
+void pqUnlockUpdateTable(PGconn* conn) {
+    PQclear(PQexec(
+        conn, "SELECT pg_advisory_unlock(hashtext('engine.update'));"));
+}
+
 // Returns 0 on success of creating the table, and -1 on failure
-int pqInsertUpdate(PGconn* conn, char* revision_id) {
-    const char* paramValues[1] = {revision_id};
+int pqInsertUpdate(PGconn* conn, int revision_id) {
+    // Sent as a binary int4, so it is never formatted as text.
+    uint32_t    value = htonl(revision_id);
+    const char* paramValues[1] = {(char*)&value};
+    const Oid   paramTypes[1] = {PQ_INT4_OID};
+    const int   paramLengths[1] = {sizeof(value)};
+    const int   paramFormats[1] = {1};
 
     PGresult* res = PQexecParams(conn,
                                  "INSERT INTO update (revision_id) "
                                  "VALUES ($1);",
-                                 1, NULL, paramValues, NULL, NULL, 0);
+                                 1, paramTypes, paramValues, paramLengths,
+                                 paramFormats, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "INSERT failed: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -750,6 +941,12 @@ void pqSummarizeUpdateTable(PGconn* conn) {
         PQclear(res);
         return;
     }
+    // Machine-readable formats get the rows themselves rather than prose.
+    if (strcmp(fmtGetFormat(), "pretty")) {
+        pqPrintTable(res);
+        PQclear(res);
+        return;
+    }
     int i = 0;
     int tuples = PQntuples(res);
     while (i < tuples) {
@@ -768,19 +965,6 @@ void pqSummarizeUpdateTable(PGconn* conn) {
     PQclear(res);
 }
 
-// Returns 0 on success of creating the table, and -1 on failure
-int pqDropUpdateTable(PGconn* conn) {
-    PGresult* res = PQexec(conn, "DROP TABLE update;");
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        fprintf(stderr, "DROP TABLE failed: %s", PQerrorMessage(conn));
-        PQclear(res);
-        return -1;
-    }
-
-    PQclear(res);
-    return 0;
-}
-
 int pqUpdateVersionDate(PGconn* conn, char* version_id, struct tm* date) {
     char tmtodate[40];
     strftime(tmtodate, 40, "%Y-%m-%d", date);
@@ -818,23 +1002,62 @@ int pqUpdateVersionNote(PGconn* conn, char* version_id, char* note) {
     return 0;
 }
 
-size_t pqExtractPkgbuild(PGconn* conn, char* version_id) {
+// Returns the text of the PKGBUILD of version_id, or NULL if it has none or
+// the look-up failed. The row is read in binary, so content arrives as raw
+// (possibly compressed) bytes. Must be freed.
+char* pqAllocPkgbuild(PGconn* conn, char* version_id) {
     const char* paramValues[1] = {version_id};
 
-    PGresult* res = PQexecParams(conn,
-                                 "SELECT pkgbuild FROM version "
-                                 "WHERE version_id = $1;",
-                                 1, NULL, paramValues, NULL, NULL, 0);
+    PGresult* res = PQexecParams(
+        conn,
+        "SELECT is_compressed, pkgbuild_size, content FROM version "
+        "JOIN pkgbuild USING (pkgbuild_hash) WHERE version_id = $1;",
+        1, NULL, paramValues, NULL, NULL, 1);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
         PQclear(res);
-        return 0;
+        return NULL;
+    }
+    if (PQntuples(res) == 0) {
+        PQclear(res);
+        return NULL;
+    }
+    int is_compressed = PQgetvalue(res, 0, 0)[0];
+    int size = pqGetIntValue(res, 0, 1);
+
+    char* pkgbuild = (char*)errhandMalloc(size + 1);
+    if (!is_compressed) {
+        memcpy(pkgbuild, PQgetvalue(res, 0, 2), size);
+    } else {
+        uLongf len = size;
+        if (uncompress((Bytef*)pkgbuild, &len,
+                       (const Bytef*)PQgetvalue(res, 0, 2),
+                       PQgetlength(res, 0, 2)) != Z_OK ||
+            len != size) {
+            fprintf(stderr, "The stored PKGBUILD is corrupt.\n");
+            free(pkgbuild);
+            PQclear(res);
+            return NULL;
+        }
+    }
+    pkgbuild[size] = '\0';
+
+    PQclear(res);
+    return pkgbuild;
+}
+
+size_t pqExtractPkgbuild(PGconn* conn, char* version_id) {
+    const char* paramValues[1] = {version_id};
+
+    size_t bytes = 0;
+    char*  pkgbuild = pqAllocPkgbuild(conn, version_id);
+    if (pkgbuild) {
+        bytes = pkgStoreStringToFile(pkgbuild);
+        free(pkgbuild);
     }
-    size_t bytes = pkgStoreStringToFile(PQgetvalue(res, 0, 0));
     if (!bytes) {
         printf("No PKGBUILD stored in the database. Generating a default...\n");
-        PQclear(res);
-        res = PQexecParams(
+        PGresult* res = PQexecParams(
             conn,
             "SELECT engine_name, version_name, e.note, source_uri, "
             "license_name, vcs_name, code_lang_name, frag_type, frag_val "
@@ -853,34 +1076,120 @@ size_t pqExtractPkgbuild(PGconn* conn, char* version_id) {
             PQgetvalue(res, 0, 3), PQgetvalue(res, 0, 4), PQgetvalue(res, 0, 5),
             PQgetvalue(res, 0, 6), PQgetvalue(res, 0, 7),
             PQgetvalue(res, 0, 8));
+        PQclear(res);
     }
     printf("%li bytes written to PKGBUILD.\n", bytes);
 
-    PQclear(res);
     return bytes;
 }
 
+// PKGBUILDs are stored once per distinct hash. The file is only sent if the
+// version does not already have it, is compressed if that makes it smaller,
+// and the PKGBUILD it replaces is removed if no other version uses it.
 size_t pqUpdatePkgbuild(PGconn* conn, char* version_id) {
     char* pkgbuild = pkgAllocStringFromFile();
     if (!pkgbuild) {
         return -1;
     }
+    size_t        len = strlen(pkgbuild);
+    unsigned char hash[HASH_SHA256_SIZE];
+    hashSha256(pkgbuild, len, hash);
+
+    const char* versionValues[1] = {version_id};
+    PGresult*   res = PQexecParams(conn,
+                                   "SELECT pkgbuild_hash FROM version "
+                                   "WHERE version_id = $1;",
+                                   1, NULL, versionValues, NULL, NULL, 1);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != 1) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        free(pkgbuild);
+        return -1;
+    }
+    if (PQgetlength(res, 0, 0) == HASH_SHA256_SIZE &&
+        !memcmp(PQgetvalue(res, 0, 0), hash, HASH_SHA256_SIZE)) {
+        printf("PKGBUILD is unchanged, so nothing was written.\n");
+        PQclear(res);
+        free(pkgbuild);
+        return len;
+    }
+    PQclear(res);
 
-    const char* paramValues[2] = {pkgbuild, version_id};
-
-    PGresult* res = PQexecParams(conn,
-                                 "UPDATE version SET pkgbuild = $1 "
-                                 "WHERE version_id = $2;",
-                                 2, NULL, paramValues, NULL, NULL, 0);
+    uLongf bound = compressBound(len);
+    char*  compressed = (char*)errhandMalloc(bound);
+    int    is_compressed =
+        compress2((Bytef*)compressed, &bound, (const Bytef*)pkgbuild, len,
+                  Z_BEST_COMPRESSION) == Z_OK &&
+        bound < len;
+
+    char size_str[21];
+    snprintf(size_str, 21, "%zu", len);
+    const char* storeValues[4] = {(char*)hash, is_compressed ? "t" : "f",
+                                  size_str,
+                                  is_compressed ? compressed : pkgbuild};
+    const int   storeLengths[4] = {HASH_SHA256_SIZE, 0, 0,
+                                   is_compressed ? (int)bound : (int)len};
+    const int   storeFormats[4] = {1, 0, 0, 1};
+    const char* updateValues[2] = {(char*)hash, version_id};
+    const int   updateLengths[2] = {HASH_SHA256_SIZE, 0};
+    const int   updateFormats[2] = {1, 0};
+
+    int nested = ioBegin(conn);
+    if (nested == -1) {
+        free(compressed);
+        free(pkgbuild);
+        return -1;
+    }
+    res = PQexecParams(conn,
+                       "INSERT INTO pkgbuild (pkgbuild_hash, is_compressed, "
+                       "pkgbuild_size, content) VALUES ($1, $2, $3, $4) "
+                       "ON CONFLICT (pkgbuild_hash) DO NOTHING;",
+                       4, NULL, storeValues, storeLengths, storeFormats, 0);
+    free(compressed);
+    free(pkgbuild);
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "INSERT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        ioRollback(conn, nested);
+        return -1;
+    }
+    PQclear(res);
+
+    // Joining version to itself reads the hash from before the update.
+    res = PQexecParams(conn,
+                       "UPDATE version v SET pkgbuild_hash = $1 "
+                       "FROM version old WHERE v.version_id = $2 "
+                       "AND old.version_id = $2 RETURNING old.pkgbuild_hash;",
+                       2, NULL, updateValues, updateLengths, updateFormats, 1);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "UPDATE failed: %s", PQerrorMessage(conn));
         PQclear(res);
-        free(pkgbuild);
+        ioRollback(conn, nested);
+        return -1;
+    }
+    if (PQntuples(res) == 1 && !PQgetisnull(res, 0, 0)) {
+        const char* oldValues[1] = {PQgetvalue(res, 0, 0)};
+        const int   oldLengths[1] = {PQgetlength(res, 0, 0)};
+        const int   oldFormats[1] = {1};
+        PGresult*   del = PQexecParams(
+            conn,
+            "DELETE FROM pkgbuild WHERE pkgbuild_hash = $1 AND NOT EXISTS "
+            "(SELECT 1 FROM version WHERE pkgbuild_hash = $1);",
+            1, NULL, oldValues, oldLengths, oldFormats, 0);
+        if (PQresultStatus(del) != PGRES_COMMAND_OK) {
+            fprintf(stderr, "DELETE failed: %s", PQerrorMessage(conn));
+            PQclear(del);
+            PQclear(res);
+            ioRollback(conn, nested);
+            return -1;
+        }
+        PQclear(del);
+    }
+    PQclear(res);
+    if (ioCommit(conn, nested) == -1) {
         return -1;
     }
-    size_t len = strlen(pkgbuild);
     printf("%lu bytes written from PKGBUILD to database.\n", len);
-    free(pkgbuild);
 
     return len;
 }
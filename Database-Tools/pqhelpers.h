@@ -22,20 +22,32 @@ limitations under the License.
 
 extern PGconn* pqInitConnection(const char* conninfo);
 
+// The OID of int4 in pg_type, for binary parameters.
+#define PQ_INT4_OID 23
+// The number of days from 1970-01-01 to 2000-01-01, the epoch of binary dates.
+#define PQ_EPOCH_DAYS_2000 10957
+
 extern void pqPrintTable(PGresult* res);
+extern int  pqGetIntValue(const PGresult* res, int row, int col);
+extern int  pqGetDateValue(const PGresult* res, int row, int col);
 
-extern void  pqListEngines(PGconn* conn);
-extern int*  pqAllocEngineIdsWithName(PGconn* conn, char* engine_name);
-extern char* pqAllocVersionIdWithName(PGconn* conn, char* engine_id,
-                                      char* version_name);
-extern void  pqListEnginesWithName(PGconn* conn, char* engine_name);
+extern void      pqListEngines(PGconn* conn);
+extern int*      pqAllocEngineIdsWithName(PGconn* conn, char* engine_name);
+extern char*     pqAllocVersionIdWithName(PGconn* conn, char* engine_id,
+                                          char* version_name);
+extern void      pqListEnginesWithName(PGconn* conn, char* engine_name);
+extern PGresult* pqAllocEngineMatches(PGconn* conn, char* pattern);
+extern void      pqListEngineMatches(PGconn* conn, char* pattern);
 
 extern void  pqListNote(PGconn* conn, char* engine_id);
 extern void  pqListAuthors(PGconn* conn, char* engine_id);
 extern void  pqListSources(PGconn* conn, char* engine_id);
 extern void  pqListVersions(PGconn* conn, char* engine_id);
 extern void  pqListVersionDetails(PGconn* conn, char* version_id);
+extern void  pqListEngineDetails(PGconn* conn, char* engine_id);
+extern void  pqListLineage(PGconn* conn, char* engine_id, int descendants);
 extern char* pqAllocLatestVersionDate(PGconn* conn, char* engine_id);
+extern int   pqRefreshLatestVersions(PGconn* conn);
 
 extern char* pqInsertEngine(PGconn* conn, char* engine_name, char* note);
 
@@ -64,13 +76,14 @@ extern code_link*  pqAllocSourceFromVersion(PGconn* conn, char* version_id);
 extern revision*   pqAllocRevisionFromVersion(PGconn* conn, char* revision_id);
 
 extern int  pqCreateUpdateTable(PGconn* conn);
-extern int  pqInsertUpdate(PGconn* conn, char* revision_id);
+extern void pqUnlockUpdateTable(PGconn* conn);
+extern int  pqInsertUpdate(PGconn* conn, int revision_id);
 extern void pqSummarizeUpdateTable(PGconn* conn);
-extern int  pqDropUpdateTable(PGconn* conn);
 
 extern int pqUpdateVersionDate(PGconn* conn, char* version_id, struct tm* date);
 extern int pqUpdateVersionNote(PGconn* conn, char* version_id, char* note);
 
+extern char*  pqAllocPkgbuild(PGconn* conn, char* version_id);
 extern size_t pqExtractPkgbuild(PGconn* conn, char* version_id);
 extern size_t pqUpdatePkgbuild(PGconn* conn, char* version_id);
 
@@ -0,0 +1,859 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "srchelpers.h"
+#include "buildhelpers.h"
+#include "fmthelpers.h"
+#include "globals.h"
+#include "iohelpers.h"
+#include "pkghelpers.h"
+#include "pqhelpers.h"
+#include "vcshelpers.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <libpq-fe.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const int SRC_MAX_THREADS = 8;
+
+// How a build system builds an engine and where the executable ends up. Both
+// build and binary are formats given the name of the build file, are run in
+// the directory holding it, and binary expands to a single shell word. The
+// name is double-quoted wherever it is used, as it may hold spaces.
+typedef struct {
+    const char* name;
+    const char* depends;
+    const char* makedepends;
+    const char* build;
+    const char* binary;
+} src_recipe;
+
+static const src_recipe recipes[SRC_BUILD_SYSTEM_COUNT] = {
+    [SRC_CARGO] = {"Cargo", "", "'cargo'", "  cargo build --release\n",
+                   "\"$(find target/release -maxdepth 1 -type f -perm -u+x "
+                   "! -name '*.so' | head -n 1)\""},
+    [SRC_CMAKE] = {"CMake", "'glibc'", "'cmake'",
+                   "  cmake -B build -S . -DCMAKE_BUILD_TYPE=Release\n"
+                   "  cmake --build build\n",
+                   "\"$(find build -maxdepth 2 -type f -perm -u+x "
+                   "! -name '*.so*' ! -path '*/CMakeFiles/*' | head -n 1)\""},
+    [SRC_MESON] = {"Meson", "'glibc'", "'meson'",
+                   "  meson setup --buildtype=release build\n"
+                   "  meson compile -C build\n",
+                   "\"$(find build -maxdepth 2 -type f -perm -u+x "
+                   "! -name '*.so*' ! -path '*/meson-*' | head -n 1)\""},
+    [SRC_ZIG] = {"Zig", "", "'zig'", "  zig build -Doptimize=ReleaseFast\n",
+                 "\"$(find zig-out/bin -type f | head -n 1)\""},
+    [SRC_GO] = {"Go", "", "'go'", "  go build -trimpath -o \"$pkgname\" .\n",
+                "\"$pkgname\""},
+    [SRC_DOTNET] = {".NET", "", "'dotnet-sdk'",
+                    "  dotnet publish \"%s\" -c Release -r linux-x64 "
+                    "--self-contained -p:PublishSingleFile=true -o out\n",
+                    "\"out/$(basename \"%s\" .csproj)\""},
+    [SRC_MAKE] = {"Make", "'glibc'", "'make'", "  make -f \"%s\"\n",
+                  "\"$(find . -maxdepth 1 -type f -perm -u+x -newer \"%s\" "
+                  "! -name '*.sh' | head -n 1)\""},
+};
+
+// A directory waiting to be read by srcScanThread. path is the full path, of
+// which the part from rel is relative to the root of the tree.
+typedef struct src_dir {
+    char*           path;
+    size_t          rel;
+    int             depth;
+    struct src_dir* next;
+} src_dir;
+
+// The state shared by the threads of a scan. pending counts the directories
+// queued or being read, and the scan is over when it drops to 0.
+static pthread_mutex_t walk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  walk_ready = PTHREAD_COND_INITIALIZER;
+static src_dir*        walk_queue;
+static int             walk_pending;
+static src_tree*       walk_tree;
+
+// Returns the build system whose build file is named name, or -1 if it is
+// not a build file.
+static int srcBuildSystemOf(const char* name) {
+    size_t len = strlen(name);
+    if (!strcmp(name, "Cargo.toml")) {
+        return SRC_CARGO;
+    } else if (!strcmp(name, "CMakeLists.txt")) {
+        return SRC_CMAKE;
+    } else if (!strcmp(name, "meson.build")) {
+        return SRC_MESON;
+    } else if (!strcmp(name, "build.zig")) {
+        return SRC_ZIG;
+    } else if (!strcmp(name, "go.mod")) {
+        return SRC_GO;
+    } else if (len > 7 && !strcmp(name + len - 7, ".csproj")) {
+        return SRC_DOTNET;
+    } else if (!strcmp(name, "Makefile") || !strcmp(name, "makefile") ||
+               !strcmp(name, "GNUmakefile")) {
+        return SRC_MAKE;
+    }
+    return -1;
+}
+
+// Records the build file at path, depth directories into the tree, if it is
+// the shallowest of its build system found so far. Of files equally deep,
+// the first by name is kept, so the result does not depend on which thread
+// got there first. Must be called holding walk_lock.
+static void srcRecord(int kind, const char* path, int depth) {
+    char* kept = walk_tree->file[kind];
+    if (kept == NULL || depth < walk_tree->depth[kind] ||
+        (depth == walk_tree->depth[kind] && strcmp(path, kept) < 0)) {
+        free(kept);
+        walk_tree->file[kind] = errhandStrdup(path);
+        walk_tree->depth[kind] = depth;
+    }
+}
+
+// Reads one directory, recording its build files and queueing the
+// directories in it. Hidden directories, such as .git, are skipped, as is
+// anything deeper than SRC_SCAN_DEPTH.
+static void srcReadDir(src_dir* dir) {
+    DIR* d = opendir(dir->path);
+    if (d == NULL) {
+        perror(dir->path);
+        return;
+    }
+    src_dir*       found = NULL;
+    int            found_count = 0;
+    int            file_count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(dirfd(d), entry->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR
+                   : S_ISREG(st.st_mode) ? DT_REG
+                                         : DT_UNKNOWN;
+        }
+        if (type == DT_DIR && dir->depth < SRC_SCAN_DEPTH) {
+            src_dir* sub = errhandMalloc(sizeof(*sub));
+            sub->path = errhandMalloc(strlen(dir->path) +
+                                      strlen(entry->d_name) + 2);
+            sprintf(sub->path, "%s/%s", dir->path, entry->d_name);
+            sub->rel = dir->rel;
+            sub->depth = dir->depth + 1;
+            sub->next = found;
+            found = sub;
+            found_count++;
+        } else if (type == DT_REG) {
+            file_count++;
+            int kind = srcBuildSystemOf(entry->d_name);
+            if (kind != -1) {
+                char* path = errhandMalloc(strlen(dir->path) +
+                                           strlen(entry->d_name) + 2);
+                sprintf(path, "%s/%s", dir->path, entry->d_name);
+                pthread_mutex_lock(&walk_lock);
+                srcRecord(kind, path + dir->rel, dir->depth);
+                pthread_mutex_unlock(&walk_lock);
+                free(path);
+            }
+        }
+    }
+    closedir(d);
+
+    // Everything found is queued at once, so the lock is taken once per
+    // directory rather than once per entry.
+    pthread_mutex_lock(&walk_lock);
+    walk_tree->dir_count++;
+    walk_tree->file_count += file_count;
+    if (found != NULL) {
+        src_dir* last = found;
+        while (last->next != NULL) {
+            last = last->next;
+        }
+        last->next = walk_queue;
+        walk_queue = found;
+        walk_pending += found_count;
+        pthread_cond_broadcast(&walk_ready);
+    }
+    pthread_mutex_unlock(&walk_lock);
+}
+
+// Helper function to srcScanTree that runs concurrently, reading directories
+// off the queue until none are queued or being read.
+static void* srcScanThread(void* unused) {
+    pthread_mutex_lock(&walk_lock);
+    while (1) {
+        while (walk_queue == NULL && walk_pending > 0) {
+            pthread_cond_wait(&walk_ready, &walk_lock);
+        }
+        if (walk_queue == NULL) {
+            break;
+        }
+        src_dir* dir = walk_queue;
+        walk_queue = dir->next;
+        pthread_mutex_unlock(&walk_lock);
+
+        srcReadDir(dir);
+        free(dir->path);
+        free(dir);
+
+        pthread_mutex_lock(&walk_lock);
+        walk_pending--;
+        if (walk_pending == 0) {
+            pthread_cond_broadcast(&walk_ready);
+        }
+    }
+    pthread_mutex_unlock(&walk_lock);
+
+    return NULL;
+}
+
+// Walks the tree at root with a thread per core, up to SRC_MAX_THREADS,
+// filling tree with the build files in it. Returns 0 on success, or -1 if
+// root could not be read. The tree must be freed with srcFreeTree.
+int srcScanTree(const char* root, src_tree* tree) {
+    memset(tree, 0, sizeof(*tree));
+    struct stat st;
+    if (stat(root, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Opening of directory %s failed.\n", root);
+        return -1;
+    }
+    src_dir* dir = errhandMalloc(sizeof(*dir));
+    dir->path = errhandStrdup(root);
+    dir->rel = strlen(root) + 1;
+    dir->depth = 0;
+    dir->next = NULL;
+    walk_queue = dir;
+    walk_pending = 1;
+    walk_tree = tree;
+
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count < 1) {
+        thread_count = 1;
+    } else if (thread_count > SRC_MAX_THREADS) {
+        thread_count = SRC_MAX_THREADS;
+    }
+    pthread_t tid[SRC_MAX_THREADS];
+    for (int i = 0; i < thread_count; i++) {
+        pthread_create(&tid[i], NULL, srcScanThread, NULL);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    walk_tree = NULL;
+
+    return 0;
+}
+
+void srcFreeTree(src_tree* tree) {
+    for (int i = 0; i < SRC_BUILD_SYSTEM_COUNT; i++) {
+        free(tree->file[i]);
+        tree->file[i] = NULL;
+    }
+}
+
+// Returns the build system of the shallowest build file in tree, or -1 if
+// it has none. A Makefile beside the files of another build system is
+// usually a wrapper around it, which is why make comes last.
+int srcPreferredBuildSystem(src_tree* tree) {
+    int kind = -1;
+    for (int i = 0; i < SRC_BUILD_SYSTEM_COUNT; i++) {
+        if (tree->file[i] != NULL &&
+            (kind == -1 || tree->depth[i] < tree->depth[kind])) {
+            kind = i;
+        }
+    }
+    return kind;
+}
+
+// Extracts the sources of pkgbuild into SRC_WORKSPACE/src with makepkg,
+// without building them. Returns 0 on success, or -1 on failure.
+static int srcExtract(const char* pkgbuild) {
+    mkdir(BUILD_ROOT, 0777);
+    mkdir(SRC_WORKSPACE, 0777);
+    if (pkgStoreStringToPath(pkgbuild, SRC_WORKSPACE "/PKGBUILD") == 0) {
+        return -1;
+    }
+    // Anything buffered would otherwise be written by both processes.
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        if (chdir(SRC_WORKSPACE) == -1) {
+            perror(SRC_WORKSPACE);
+            _exit(127);
+        }
+        execlp("makepkg", "makepkg", "--nobuild", "--cleanbuild", "--nodeps",
+               "--skipinteg", "--noconfirm", (char*)NULL);
+        perror("makepkg");
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Extraction of sources with makepkg failed.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Returns a copy of s in a, escaped to be placed inside double quotes.
+static char* srcArenaQuote(arena* a, const char* s) {
+    char* out = arenaAlloc(a, 2 * strlen(s) + 1);
+    char* p = out;
+    for (; *s != '\0'; s++) {
+        if (strchr("\"$`\\", *s) != NULL) {
+            *p++ = '\\';
+        }
+        *p++ = *s;
+    }
+    *p = '\0';
+    return out;
+}
+
+// Returns the directory of the build file path, relative to $srcdir and
+// quoted for the PKGBUILD, with the checkout named $pkgname if it is.
+static char* srcArenaBuildDir(arena* a, const char* path,
+                              const char* pkgname) {
+    char*  dir = arenaStrdup(a, path);
+    char*  slash = strrchr(dir, '/');
+    size_t top = strcspn(dir, "/");
+    if (slash == NULL) {
+        return "$srcdir";
+    }
+    *slash = '\0';
+    if (pkgname != NULL && strlen(pkgname) == top &&
+        !strncmp(dir, pkgname, top)) {
+        return arenaSprintf(a, "$srcdir/$pkgname%s",
+                            srcArenaQuote(a, dir + top));
+    }
+    return arenaSprintf(a, "$srcdir/%s", srcArenaQuote(a, dir));
+}
+
+// Replaces pkgbuild with next if next is not NULL, or otherwise reports that
+// what would have been changed was left as it was.
+static char* srcApply(char* pkgbuild, char* next, const char* what) {
+    if (next == NULL) {
+        fmtStatus("The %s of PKGBUILD was left as it was.\n", what);
+        return pkgbuild;
+    }
+    free(pkgbuild);
+    return next;
+}
+
+// Extracts the sources of the PKGBUILD in the current directory, detects the
+// build system they use, and fills in the build() and package() functions
+// and the dependencies of the PKGBUILD to match. Functions which have been
+// written already are left alone. Returns 0 on success, or -1 on failure.
+int srcGeneratePkgbuild() {
+    char* pkgbuild = pkgAllocStringFromFile();
+    if (pkgbuild == NULL) {
+        return -1;
+    }
+    if (srcExtract(pkgbuild) == -1) {
+        free(pkgbuild);
+        return -1;
+    }
+    src_tree tree;
+    if (srcScanTree(SRC_WORKSPACE "/src", &tree) == -1) {
+        free(pkgbuild);
+        return -1;
+    }
+    fmtStatus("Scanned %d files in %d directories.\n", tree.file_count,
+              tree.dir_count);
+    for (int i = 0; i < SRC_BUILD_SYSTEM_COUNT; i++) {
+        if (tree.file[i] != NULL) {
+            fmtStatus("Found %s build file %s.\n", recipes[i].name,
+                      tree.file[i]);
+        }
+    }
+    int kind = srcPreferredBuildSystem(&tree);
+    if (kind == -1) {
+        fprintf(stderr, "No build system was recognized in the sources.\n");
+        srcFreeTree(&tree);
+        free(pkgbuild);
+        return -1;
+    }
+    const src_recipe* recipe = &recipes[kind];
+    fmtStatus("Building with %s.\n", recipe->name);
+
+    arena pieces;
+    arenaInit(&pieces, 4096);
+    char* pkgname = NULL;
+    char* line = strstr(pkgbuild, "\npkgname=");
+    if (line != NULL) {
+        line += strlen("\npkgname=");
+        pkgname = arenaSprintf(&pieces, "%.*s", (int)strcspn(line, "\n"),
+                               line);
+    }
+    char* file = strrchr(tree.file[kind], '/');
+    file = srcArenaQuote(&pieces, file == NULL ? tree.file[kind] : file + 1);
+    char* dir = srcArenaBuildDir(&pieces, tree.file[kind], pkgname);
+    // The documentation is installed from the top of the checkout, where it
+    // is usually kept even when the build file is further down.
+    char* top = dir;
+    size_t top_len = strcspn(tree.file[kind], "/");
+    if (tree.file[kind][top_len] == '/') {
+        top = srcArenaBuildDir(
+            &pieces, arenaSprintf(&pieces, "%.*s/", (int)top_len,
+                                  tree.file[kind]),
+            pkgname);
+    }
+
+    char* build =
+        arenaSprintf(&pieces, "  cd \"%s\"\n%s", dir,
+                     arenaSprintf(&pieces, recipe->build, file));
+    char* package = arenaSprintf(
+        &pieces,
+        "  cd \"%s\"\n"
+        "  for doc in README* LICENSE* COPYING* AUTHORS*; do\n"
+        "    if [ -f \"$doc\" ]; then\n"
+        "      install -Dm644 \"$doc\" \"$pkgdir/usr/share/$pkgname/$doc\"\n"
+        "    fi\n"
+        "  done\n"
+        "  cd \"%s\"\n"
+        "  install -Dm755 %s \"$pkgdir/usr/bin/$pkgname\"\n",
+        top, dir, arenaSprintf(&pieces, recipe->binary, file));
+
+    pkgbuild = srcApply(pkgbuild,
+                        pkgAllocWithFunction(pkgbuild, "build", build),
+                        "build()");
+    pkgbuild = srcApply(pkgbuild,
+                        pkgAllocWithFunction(pkgbuild, "package", package),
+                        "package()");
+    pkgbuild = srcApply(pkgbuild,
+                        pkgAllocWithDepends(pkgbuild, "depends",
+                                            recipe->depends),
+                        "depends array");
+    pkgbuild = srcApply(pkgbuild,
+                        pkgAllocWithDepends(pkgbuild, "makedepends",
+                                            recipe->makedepends),
+                        "makedepends array");
+
+    int ret = pkgStoreStringToFile(pkgbuild) == 0 ? -1 : 0;
+    arenaFree(&pieces);
+    srcFreeTree(&tree);
+    free(pkgbuild);
+
+    return ret;
+}
+
+// The language of source files by extension, named as in the code_lang table.
+// Extensions used by several languages go to the one engines are likelier to
+// be written in.
+typedef struct {
+    const char* ext;
+    const char* lang;
+} src_ext;
+
+static const src_ext extensions[] = {
+    {"adb", "Ada"},          {"ads", "Ada"},         {"asm", "Assembly"},
+    {"s", "Assembly"},       {"S", "Assembly"},      {"bas", "BASIC"},
+    {"sh", "Bash"},          {"bash", "Bash"},       {"c", "C"},
+    {"h", "C"},              {"cc", "C++"},          {"cpp", "C++"},
+    {"cxx", "C++"},          {"c++", "C++"},         {"C", "C++"},
+    {"hh", "C++"},           {"hpp", "C++"},         {"hxx", "C++"},
+    {"h++", "C++"},          {"ipp", "C++"},         {"inl", "C++"},
+    {"cs", "C#"},            {"clj", "Clojure"},     {"cljc", "Clojure"},
+    {"cljs", "Clojure"},     {"d", "D"},             {"dart", "Dart"},
+    {"dpr", "Delphi"},       {"pas", "Delphi"},      {"f", "Fortran"},
+    {"for", "Fortran"},      {"f90", "Fortran"},     {"f95", "Fortran"},
+    {"f03", "Fortran"},      {"4th", "Forth"},       {"fth", "Forth"},
+    {"fs", "Forth"},         {"pp", "Free Pascal"},  {"lpr", "Free Pascal"},
+    {"fr", "Frege"},         {"go", "Go"},           {"hs", "Haskell"},
+    {"lhs", "Haskell"},      {"java", "Java"},       {"js", "JavaScript"},
+    {"mjs", "JavaScript"},   {"cjs", "JavaScript"},  {"kt", "Kotlin"},
+    {"kts", "Kotlin"},       {"lua", "Lua"},         {"nim", "Nim"},
+    {"ml", "O'Caml"},        {"mli", "O'Caml"},      {"php", "PHP"},
+    {"py", "Python"},        {"rb", "Ruby"},         {"rs", "Rust"},
+    {"scm", "Scheme"},       {"ss", "Scheme"},       {"swift", "Swift"},
+    {"ts", "TypeScript"},    {"vb", "Visual Basic"}, {"zig", "Zig"},
+};
+static const int extension_count = sizeof(extensions) / sizeof(*extensions);
+
+// The language of scripts without an extension by their interpreter, which
+// need only start with the name given, so python3 is Python.
+static const src_ext interpreters[] = {
+    {"sh", "Bash"},   {"bash", "Bash"},       {"python", "Python"},
+    {"ruby", "Ruby"}, {"node", "JavaScript"}, {"lua", "Lua"},
+    {"php", "PHP"},
+};
+static const int interpreter_count =
+    sizeof(interpreters) / sizeof(*interpreters);
+
+// Returns the number of lines of data, counting a last line without a
+// newline. Eight bytes are compared at once: x has a zero byte wherever data
+// has a newline, and a byte of x is zero exactly when neither its low seven
+// bits, carried into the top bit by adding 0x7f, nor its top bit are set.
+size_t srcCountLines(const char* data, size_t size) {
+    const uint64_t low = 0x7f7f7f7f7f7f7f7fULL;
+    const uint64_t newlines = 0x0a0a0a0a0a0a0a0aULL;
+    size_t         lines = 0;
+    size_t         i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        uint64_t x = word ^ newlines;
+        uint64_t nonzero = ((x & low) + low) | x;
+        lines += __builtin_popcountll(~nonzero & ~low);
+    }
+    for (; i < size; i++) {
+        lines += data[i] == '\n';
+    }
+    if (size > 0 && data[size - 1] != '\n') {
+        lines++;
+    }
+    return lines;
+}
+
+// Returns the language of the interpreter named on the #! line of data, or
+// NULL if it names none of interpreters.
+static const char* srcClassifyShebang(const char* data, size_t size) {
+    char   line[128];
+    size_t len = 0;
+    while (len + 2 < size && len < sizeof(line) - 1 &&
+           data[len + 2] != '\n') {
+        line[len] = data[len + 2];
+        len++;
+    }
+    line[len] = '\0';
+    // The interpreter is the program run, or what env is asked to run.
+    char* word = strtok(line, " \t\r");
+    while (word != NULL) {
+        char* name = strrchr(word, '/');
+        name = name == NULL ? word : name + 1;
+        if (strcmp(name, "env") != 0 && name[0] != '-') {
+            for (int i = 0; i < interpreter_count; i++) {
+                const char* interp = interpreters[i].ext;
+                if (!strncmp(name, interp, strlen(interp)) &&
+                    strspn(name + strlen(interp), "0123456789.") ==
+                        strlen(name + strlen(interp))) {
+                    return interpreters[i].lang;
+                }
+            }
+            return NULL;
+        }
+        word = strtok(NULL, " \t\r");
+    }
+    return NULL;
+}
+
+// Returns the language of the file at path, whose contents are data, by its
+// extension, or by its #! line if it has none. Returns NULL if the file is
+// not source code in a known language.
+const char* srcClassifyFile(const char* path, const char* data, size_t size) {
+    const char* name = strrchr(path, '/');
+    name = name == NULL ? path : name + 1;
+    const char* dot = strrchr(name, '.');
+    if (dot != NULL && dot != name) {
+        for (int i = 0; i < extension_count; i++) {
+            if (!strcmp(dot + 1, extensions[i].ext)) {
+                return extensions[i].lang;
+            }
+        }
+        return NULL;
+    }
+    if (size > 2 && data[0] == '#' && data[1] == '!') {
+        return srcClassifyShebang(data, size);
+    }
+    return NULL;
+}
+
+// Adds the file at path to the statistics in payload, if it is source code.
+static void srcCountFile(const char* path, const char* data, size_t size,
+                         void* payload) {
+    src_lang_stats* stats = payload;
+    const char*     lang = srcClassifyFile(path, data, size);
+    if (lang == NULL) {
+        return;
+    }
+    int i = 0;
+    while (i < stats->lang_count && strcmp(stats->lang[i].lang, lang)) {
+        i++;
+    }
+    if (i == stats->lang_count) {
+        if (i == SRC_LANG_MAX) {
+            return;
+        }
+        stats->lang[i].lang = lang;
+        stats->lang_count++;
+    }
+    stats->lang[i].file_count++;
+    stats->lang[i].line_count += srcCountLines(data, size);
+    stats->lang[i].byte_count += size;
+}
+
+// Stores stats, counted from commit id, as the statistics of version_id in
+// place of any stored before. A version without a language is given the one
+// with the most lines. Returns 0 on success, or -1 on failure.
+static int srcStoreLangStats(PGconn* conn, const char* version_id,
+                             const char* id, src_lang_stats* stats) {
+    int nested = ioBegin(conn);
+    if (nested == -1) {
+        return -1;
+    }
+    const char* paramValues[6] = {version_id, id};
+    PGresult*   res = PQexecParams(
+        conn, "DELETE FROM version_lang_stat WHERE version_id = $1;", 1,
+        NULL, paramValues, NULL, NULL, 0);
+    int ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+    PQclear(res);
+
+    for (int i = 0; ok && i < stats->lang_count; i++) {
+        char file_count[16];
+        char line_count[24];
+        char byte_count[24];
+        snprintf(file_count, sizeof(file_count), "%d",
+                 stats->lang[i].file_count);
+        snprintf(line_count, sizeof(line_count), "%lld",
+                 stats->lang[i].line_count);
+        snprintf(byte_count, sizeof(byte_count), "%lld",
+                 stats->lang[i].byte_count);
+        paramValues[2] = stats->lang[i].lang;
+        paramValues[3] = file_count;
+        paramValues[4] = line_count;
+        paramValues[5] = byte_count;
+        // A language missing from code_lang inserts nothing.
+        res = PQexecParams(
+            conn,
+            "INSERT INTO version_lang_stat (version_id, code_lang_id, "
+            "commit_id, file_count, line_count, byte_count) "
+            "SELECT $1, code_lang_id, $2, $4, $5, $6 FROM code_lang "
+            "WHERE code_lang_name = $3 ORDER BY code_lang_id LIMIT 1;",
+            6, NULL, paramValues, NULL, NULL, 0);
+        ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+    }
+    if (ok) {
+        res = PQexecParams(
+            conn,
+            "UPDATE version SET code_lang_id = (SELECT code_lang_id "
+            "FROM version_lang_stat s WHERE s.version_id = $1 "
+            "ORDER BY line_count DESC LIMIT 1) "
+            "WHERE version_id = $1 AND code_lang_id IS NULL;",
+            1, NULL, paramValues, NULL, NULL, 0);
+        ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+    }
+    if (!ok) {
+        fprintf(stderr, "Storing of language statistics failed: %s",
+                PQerrorMessage(conn));
+        ioRollback(conn, nested);
+        return -1;
+    }
+    return ioCommit(conn, nested);
+}
+
+// The versions whose sources are counted, with the language recorded for
+// them and the commit last counted, if any.
+#define SRC_SELECT                                                             \
+    "SELECT version_id, engine_name, version_name, source_uri, vcs_name, "     \
+    "frag_type, frag_val, code_lang_name, (SELECT commit_id "                  \
+    "FROM version_lang_stat s WHERE s.version_id = v.version_id LIMIT 1) "     \
+    "FROM version v JOIN engine USING (engine_id) "                            \
+    "JOIN revision USING (revision_id) JOIN source USING (source_id) "         \
+    "JOIN vcs USING (vcs_id) LEFT JOIN code_lang USING (code_lang_id) "
+
+// Shared by the threads of srcCountVersions. The connection is only used by
+// one thread at a time.
+static pthread_mutex_t count_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t count_conn_lock = PTHREAD_MUTEX_INITIALIZER;
+static int             count_idx;
+
+typedef struct {
+    PGconn*   conn;
+    PGresult* res;
+    int       counted;
+    int       failed;
+} src_count_info;
+
+// Counts the sources of the version in row of res, unless the commit counted
+// last is still the one its revision refers to. Returns 0 if they were
+// counted, 1 if they were counted already, or -1 on failure. Only versions
+// whose sources are in git can be counted.
+static int srcCountRow(PGconn* conn, PGresult* res, int row,
+                       arena* scratch) {
+    const char* version_id = PQgetvalue(res, row, 0);
+    const char* engine_name = PQgetvalue(res, row, 1);
+    const char* version_name = PQgetvalue(res, row, 2);
+    if (strncmp(PQgetvalue(res, row, 4), "git", 3) != 0) {
+        fprintf(stderr, "Counting lines of %s sources is not supported.\n",
+                PQgetvalue(res, row, 4));
+        return -1;
+    }
+    revision rev =
+        borrowRevision("", PQgetvalue(res, row, 5), PQgetvalue(res, row, 6),
+                       PQgetisnull(res, row, 6));
+    const char* known_id =
+        PQgetisnull(res, row, 8) ? NULL : PQgetvalue(res, row, 8);
+    char           id[GIT_OID_HEXSZ + 1];
+    src_lang_stats stats = {0};
+    int ret = vcsWalkRevisionGit(&rev, PQgetvalue(res, row, 3), known_id, id,
+                                 scratch, srcCountFile, &stats);
+    if (ret != 0) {
+        return ret;
+    }
+
+    long long lines = 0;
+    int       top = -1;
+    for (int i = 0; i < stats.lang_count; i++) {
+        lines += stats.lang[i].line_count;
+        if (top == -1 ||
+            stats.lang[i].line_count > stats.lang[top].line_count) {
+            top = i;
+        }
+    }
+    pthread_mutex_lock(&count_conn_lock);
+    ret = srcStoreLangStats(conn, version_id, id, &stats);
+    pthread_mutex_unlock(&count_conn_lock);
+    if (ret == -1) {
+        return -1;
+    }
+    if (top == -1) {
+        fmtStatus("%s %s: no source files found.\n", engine_name,
+                  version_name);
+    } else if (PQgetisnull(res, row, 7) ||
+               !strcmp(PQgetvalue(res, row, 7), stats.lang[top].lang)) {
+        fmtStatus("%s %s: %lld lines, mostly %s.\n", engine_name,
+                  version_name, lines, stats.lang[top].lang);
+    } else {
+        fmtStatus("%s %s: %lld lines, mostly %s, not %s as recorded.\n",
+                  engine_name, version_name, lines, stats.lang[top].lang,
+                  PQgetvalue(res, row, 7));
+    }
+    return 0;
+}
+
+// Helper function to srcCountVersions that runs concurrently
+static void* srcCountThread(void* td) {
+    src_count_info* info = td;
+    arena           scratch;
+    arenaInit(&scratch, 65536);
+    int rows = PQntuples(info->res);
+    while (1) {
+        pthread_mutex_lock(&count_lock);
+        int row = count_idx++;
+        pthread_mutex_unlock(&count_lock);
+        if (row >= rows) {
+            break;
+        }
+        int ret = srcCountRow(info->conn, info->res, row, &scratch);
+        if (ret == 0) {
+            info->counted++;
+        } else if (ret == -1) {
+            info->failed++;
+        }
+        arenaReset(&scratch);
+    }
+    arenaFree(&scratch);
+
+    return NULL;
+}
+
+// Counts the lines of source of version_id by language, reading the files of
+// its revision from the mirror of its source. Returns 0 on success, or -1 on
+// failure.
+int srcCountVersion(PGconn* conn, char* version_id) {
+    const char* paramValues[1] = {version_id};
+
+    PGresult* res =
+        PQexecParams(conn, SRC_SELECT "WHERE version_id = $1;", 1, NULL,
+                     paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    if (PQntuples(res) == 0) {
+        fprintf(stderr, "Version has no source to count.\n");
+        PQclear(res);
+        return -1;
+    }
+    arena scratch;
+    arenaInit(&scratch, 65536);
+    int ret = srcCountRow(conn, res, 0, &scratch);
+    arenaFree(&scratch);
+    PQclear(res);
+
+    return ret == -1 ? -1 : 0;
+}
+
+// Counts the lines of source of every version with a git source, a version
+// per thread at a time. Versions whose revision still refers to the commit
+// counted last are skipped. Returns the number of versions counted, or -1 on
+// failure.
+int srcCountVersions(PGconn* conn) {
+    PGresult* res =
+        PQexec(conn, SRC_SELECT "WHERE vcs_name LIKE 'git%' "
+                                "ORDER BY engine_name, version_name;");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+
+    count_idx = 0;
+    pthread_t      tid[SRC_MAX_THREADS];
+    src_count_info td[SRC_MAX_THREADS];
+    for (int i = 0; i < SRC_MAX_THREADS; i++) {
+        td[i] = (src_count_info){conn, res, 0, 0};
+        pthread_create(&tid[i], NULL, srcCountThread, &td[i]);
+    }
+    int counted = 0;
+    int failed = 0;
+    for (int i = 0; i < SRC_MAX_THREADS; i++) {
+        pthread_join(tid[i], NULL);
+        counted += td[i].counted;
+        failed += td[i].failed;
+    }
+    fmtStatus("\nCounted %d of %d versions, %d unchanged, %d failed.\n",
+              counted, PQntuples(res), PQntuples(res) - counted - failed,
+              failed);
+    PQclear(res);
+
+    return counted;
+}
+
+void srcListLangStats(PGconn* conn, char* version_id) {
+    const char* paramValues[1] = {version_id};
+
+    PGresult* res = PQexecParams(
+        conn,
+        "SELECT code_lang_name, file_count, line_count, byte_count, "
+        "round(100.0 * line_count / sum(line_count) OVER (), 1) AS line_pct, "
+        "commit_id FROM version_lang_stat JOIN code_lang USING (code_lang_id) "
+        "WHERE version_id = $1 ORDER BY line_count DESC;",
+        1, NULL, paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return;
+    }
+    pqPrintTable(res);
+    PQclear(res);
+}
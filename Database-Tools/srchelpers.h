@@ -0,0 +1,80 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef SRCHELPERS_H
+#define SRCHELPERS_H
+
+#include <libpq-fe.h>
+#include <stddef.h>
+
+// Where the sources of the PKGBUILD in the current directory are extracted to
+// be inspected.
+#define SRC_WORKSPACE "builds/inspect"
+// How many directories below the extracted sources build files are looked for.
+#define SRC_SCAN_DEPTH 4
+
+// The build systems a source tree can use, in the order they are preferred
+// when build files of several are found equally deep in the tree.
+typedef enum {
+    SRC_CARGO,
+    SRC_CMAKE,
+    SRC_MESON,
+    SRC_ZIG,
+    SRC_GO,
+    SRC_DOTNET,
+    SRC_MAKE,
+    SRC_BUILD_SYSTEM_COUNT
+} src_build_system;
+
+// The build files found in a source tree. For each build system, file is the
+// path from the root of the tree of its shallowest build file, or NULL if it
+// has none, and depth is the number of directories above that file.
+typedef struct {
+    char* file[SRC_BUILD_SYSTEM_COUNT];
+    int   depth[SRC_BUILD_SYSTEM_COUNT];
+    int   dir_count;
+    int   file_count;
+} src_tree;
+
+// The size of the sources in one language of a tree.
+typedef struct {
+    const char* lang; // As named in the code_lang table.
+    int         file_count;
+    long long   line_count;
+    long long   byte_count;
+} src_lang_stat;
+
+// Enough for every language of the code_lang table.
+#define SRC_LANG_MAX 32
+
+typedef struct {
+    src_lang_stat lang[SRC_LANG_MAX];
+    int           lang_count;
+} src_lang_stats;
+
+extern int  srcScanTree(const char* root, src_tree* tree);
+extern void srcFreeTree(src_tree* tree);
+extern int  srcPreferredBuildSystem(src_tree* tree);
+extern int  srcGeneratePkgbuild();
+
+extern size_t      srcCountLines(const char* data, size_t size);
+extern const char* srcClassifyFile(const char* path, const char* data,
+                                   size_t size);
+extern int         srcCountVersion(PGconn* conn, char* version_id);
+extern int         srcCountVersions(PGconn* conn);
+extern void        srcListLangStats(PGconn* conn, char* version_id);
+
+#endif
@@ -0,0 +1,216 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "storehelpers.h"
+#include "fmthelpers.h"
+#include "globals.h"
+#include "hashhelpers.h"
+#include <dirent.h>
+#include <errno.h>
+#include <libpq-fe.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Enough for STORE_ROOT, two slashes, two hex digits and a SHA-256 hash.
+#define STORE_PATH_SIZE (sizeof(STORE_ROOT) + 4 + 2 * HASH_SHA256_SIZE)
+
+// Writes the path of the stored file with the SHA-256 hash hex to path, which
+// must hold STORE_PATH_SIZE bytes.
+static void storePath(const char* hex, char* path) {
+    snprintf(path, STORE_PATH_SIZE, STORE_ROOT "/%.2s/%s", hex, hex);
+}
+
+// Moves the file at path into the store, or if the store already holds the
+// same content, drops the file, leaving path a hard link to the stored copy
+// either way. The copy is made read-only, since writing through any link
+// would change every build sharing it. Records path as an artifact of
+// build_id. Returns 0 on success, or -1 on failure.
+int storeAddArtifact(PGconn* conn, int build_id, const char* path) {
+    unsigned char digest[HASH_SHA256_SIZE];
+    char          hex[2 * HASH_SHA256_SIZE + 1];
+    size_t        size;
+    if (hashSha256File(path, digest, &size) == -1) {
+        fprintf(stderr, "Reading of %s failed.\n", path);
+        return -1;
+    }
+    hashToHex(digest, HASH_SHA256_SIZE, hex);
+    char stored[STORE_PATH_SIZE];
+    char dir[STORE_PATH_SIZE];
+    storePath(hex, stored);
+    snprintf(dir, STORE_PATH_SIZE, STORE_ROOT "/%.2s", hex);
+    mkdir(STORE_ROOT, 0777);
+    mkdir(dir, 0777);
+
+    struct stat st;
+    struct stat stored_st;
+    if (stat(path, &st) == -1) {
+        perror(path);
+        return -1;
+    }
+    if (link(path, stored) == 0) {
+        chmod(stored, st.st_mode & ~(S_IWUSR | S_IWGRP | S_IWOTH));
+    } else if (errno != EEXIST || stat(stored, &stored_st) == -1) {
+        perror(stored);
+        return -1;
+    } else if (stored_st.st_ino != st.st_ino) {
+        // The link is made beside path and renamed over it, so path always
+        // holds one copy or the other.
+        char* tmp = errhandMalloc(strlen(path) + 8);
+        sprintf(tmp, "%s.store", path);
+        unlink(tmp);
+        if (link(stored, tmp) == -1 || rename(tmp, path) == -1) {
+            perror(path);
+            unlink(tmp);
+            free(tmp);
+            return -1;
+        }
+        free(tmp);
+    }
+
+    char build_id_str[12];
+    char size_str[24];
+    snprintf(build_id_str, 12, "%d", build_id);
+    snprintf(size_str, 24, "%zu", size);
+    const char* paramValues[4] = {hex, size_str, build_id_str, path};
+
+    PGresult* res = PQexecParams(
+        conn,
+        "WITH stored AS (INSERT INTO artifact (artifact_sha256, "
+        "artifact_size) VALUES (decode($1, 'hex'), $2) "
+        "ON CONFLICT (artifact_sha256) DO NOTHING) "
+        "INSERT INTO build_artifact (build_id, artifact_sha256, path) "
+        "VALUES ($3, decode($1, 'hex'), $4) ON CONFLICT DO NOTHING;",
+        4, NULL, paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "INSERT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+    return 0;
+}
+
+// Drops the record of each artifact whose file is gone or is no longer a
+// link to its stored copy, as when it was deleted or replaced by a later
+// build. Returns 0 on success, or -1 on failure.
+static int storeDropStaleLinks(PGconn* conn) {
+    PGresult* res =
+        PQexec(conn, "SELECT build_id, path, encode(artifact_sha256, 'hex') "
+                     "FROM build_artifact;");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    for (int i = 0; i < PQntuples(res); i++) {
+        char        stored[STORE_PATH_SIZE];
+        struct stat st;
+        struct stat stored_st;
+        storePath(PQgetvalue(res, i, 2), stored);
+        if (stat(PQgetvalue(res, i, 1), &st) == 0 &&
+            stat(stored, &stored_st) == 0 && st.st_ino == stored_st.st_ino &&
+            st.st_dev == stored_st.st_dev) {
+            continue;
+        }
+        const char* paramValues[2] = {PQgetvalue(res, i, 0),
+                                      PQgetvalue(res, i, 1)};
+        PGresult*   del = PQexecParams(conn,
+                                       "DELETE FROM build_artifact "
+                                       "WHERE build_id = $1 AND path = $2;",
+                                       2, NULL, paramValues, NULL, NULL, 0);
+        if (PQresultStatus(del) != PGRES_COMMAND_OK) {
+            fprintf(stderr, "DELETE failed: %s", PQerrorMessage(conn));
+            PQclear(del);
+            PQclear(res);
+            return -1;
+        }
+        PQclear(del);
+    }
+    PQclear(res);
+    return 0;
+}
+
+// Deletes every stored file which no file under Engines/ links to any more,
+// with the records of them, so the store only grows with distinct content
+// which is still in use. Stored files no artifact record refers to, such as
+// those of an interrupted build, are deleted as well.
+// Returns the number of stored files deleted, or -1 on failure.
+int storeCollectGarbage(PGconn* conn) {
+    if (storeDropStaleLinks(conn) == -1) {
+        return -1;
+    }
+    PGresult* res = PQexec(
+        conn, "DELETE FROM artifact a WHERE NOT EXISTS (SELECT 1 FROM "
+              "build_artifact b WHERE b.artifact_sha256 = a.artifact_sha256) "
+              "RETURNING encode(artifact_sha256, 'hex'), artifact_size;");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "DELETE failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    int       deleted = 0;
+    long long freed = 0;
+    for (int i = 0; i < PQntuples(res); i++) {
+        char stored[STORE_PATH_SIZE];
+        storePath(PQgetvalue(res, i, 0), stored);
+        if (unlink(stored) == 0) {
+            deleted += 1;
+            freed += atoll(PQgetvalue(res, i, 1));
+        }
+    }
+    PQclear(res);
+
+    // A stored file with no other link is not in use, whether or not it is
+    // recorded.
+    DIR* root = opendir(STORE_ROOT);
+    if (root != NULL) {
+        struct dirent* prefix;
+        while ((prefix = readdir(root)) != NULL) {
+            if (prefix->d_name[0] == '.') {
+                continue;
+            }
+            char dir_path[STORE_PATH_SIZE];
+            snprintf(dir_path, STORE_PATH_SIZE, STORE_ROOT "/%.2s",
+                     prefix->d_name);
+            DIR* dir = opendir(dir_path);
+            if (dir == NULL) {
+                continue;
+            }
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+                char        stored[STORE_PATH_SIZE];
+                struct stat st;
+                if (strlen(entry->d_name) != 2 * HASH_SHA256_SIZE) {
+                    continue;
+                }
+                storePath(entry->d_name, stored);
+                if (stat(stored, &st) == 0 && st.st_nlink == 1 &&
+                    unlink(stored) == 0) {
+                    deleted += 1;
+                    freed += st.st_size;
+                }
+            }
+            closedir(dir);
+        }
+        closedir(root);
+    }
+    fmtStatus("%d stored artifacts deleted, freeing %lld KiB.\n", deleted,
+              freed >> 10);
+    return deleted;
+}
@@ -0,0 +1,30 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef STOREHELPERS_H
+#define STOREHELPERS_H
+
+#include <libpq-fe.h>
+
+// The content-addressed store of build artifacts. Each distinct file is kept
+// once, as STORE_ROOT/<first two hex digits of its SHA-256 hash>/<the hash>,
+// and the files under Engines/ are hard links to it.
+#define STORE_ROOT "Engines/.store"
+
+extern int storeAddArtifact(PGconn* conn, int build_id, const char* path);
+extern int storeCollectGarbage(PGconn* conn);
+
+#endif
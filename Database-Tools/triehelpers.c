@@ -0,0 +1,232 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "triehelpers.h"
+#include "globals.h"
+#include <libpq-fe.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The index used by trieObtainNameIndex, which is loaded on first use and
+// kept until trieInvalidate is called.
+static name_index* cached_index = NULL;
+
+void trieInit(trie* t) {
+    t->node_count = 1;
+    t->node_cap = 64;
+    t->nodes = errhandMalloc(t->node_cap * sizeof(trie_node));
+    t->nodes[0] = (trie_node){-1, -1, 0, 0};
+}
+
+void trieFree(trie* t) {
+    free(t->nodes);
+    t->nodes = NULL;
+    t->node_count = 0;
+    t->node_cap = 0;
+}
+
+// Returns the child of node reached by byte, or -1 if there is none.
+static int trieChild(const trie* t, int node, unsigned char byte) {
+    int child = t->nodes[node].child;
+    while (child != -1 && t->nodes[child].byte < byte) {
+        child = t->nodes[child].sibling;
+    }
+    return (child != -1 && t->nodes[child].byte == byte) ? child : -1;
+}
+
+// Returns the child of node reached by byte, adding it if there is none.
+static int trieAddChild(trie* t, int node, unsigned char byte) {
+    // Find the link which should point at the child, so the new node can be
+    // spliced in without breaking the byte order.
+    int prev = -1;
+    int child = t->nodes[node].child;
+    while (child != -1 && t->nodes[child].byte < byte) {
+        prev = child;
+        child = t->nodes[child].sibling;
+    }
+    if (child != -1 && t->nodes[child].byte == byte) {
+        return child;
+    }
+    if (t->node_count == t->node_cap) {
+        t->node_cap *= 2;
+        t->nodes = errhandRealloc(t->nodes, t->node_cap * sizeof(trie_node));
+    }
+    int added = t->node_count++;
+    t->nodes[added] = (trie_node){-1, child, byte, 0};
+    if (prev == -1) {
+        t->nodes[node].child = added;
+    } else {
+        t->nodes[prev].sibling = added;
+    }
+    return added;
+}
+
+void trieInsert(trie* t, const char* word) {
+    int node = 0;
+    for (const unsigned char* c = (const unsigned char*)word; *c; c++) {
+        node = trieAddChild(t, node, *c);
+    }
+    t->nodes[node].is_word = 1;
+}
+
+// Returns the node reached by following prefix from the root, or -1 if no
+// word starts with prefix.
+int trieFind(const trie* t, const char* prefix) {
+    int node = 0;
+    for (const unsigned char* c = (const unsigned char*)prefix; *c; c++) {
+        node = trieChild(t, node, *c);
+        if (node == -1) {
+            return -1;
+        }
+    }
+    return node;
+}
+
+typedef struct {
+    char*  word;
+    size_t word_len;
+    size_t word_cap;
+    char** words;
+    int    count;
+    int    cap;
+} trie_walk;
+
+// Appends every word below node to walk in byte order. walk->word holds the
+// bytes leading to node.
+static void trieCollect(const trie* t, int node, trie_walk* walk) {
+    if (t->nodes[node].is_word) {
+        if (walk->count == walk->cap) {
+            walk->cap *= 2;
+            walk->words =
+                errhandRealloc(walk->words, walk->cap * sizeof(char*));
+        }
+        walk->word[walk->word_len] = '\0';
+        walk->words[walk->count++] = errhandStrdup(walk->word);
+    }
+    for (int child = t->nodes[node].child; child != -1;
+         child = t->nodes[child].sibling) {
+        if (walk->word_len + 2 > walk->word_cap) {
+            walk->word_cap *= 2;
+            walk->word = errhandRealloc(walk->word, walk->word_cap);
+        }
+        walk->word[walk->word_len++] = t->nodes[child].byte;
+        trieCollect(t, child, walk);
+        walk->word_len -= 1;
+    }
+}
+
+// Returns every word in t starting with prefix, sorted bytewise, and sets
+// count to their number. The array and each word in it must be freed.
+char** trieAllocWords(const trie* t, const char* prefix, int* count) {
+    trie_walk walk = {0};
+    walk.cap = 16;
+    walk.words = errhandMalloc(walk.cap * sizeof(char*));
+    *count = 0;
+    int node = trieFind(t, prefix);
+    if (node == -1) {
+        return walk.words;
+    }
+    walk.word_len = strlen(prefix);
+    walk.word_cap = walk.word_len + 64;
+    walk.word = errhandMalloc(walk.word_cap);
+    memcpy(walk.word, prefix, walk.word_len);
+    trieCollect(t, node, &walk);
+    free(walk.word);
+    *count = walk.count;
+    return walk.words;
+}
+
+// Loads the names of every engine, version, license and programming language
+// in a single query. Returns NULL on failure. Must be freed with
+// trieFreeNameIndex.
+name_index* trieAllocNameIndex(PGconn* conn) {
+    PGresult* res =
+        PQexec(conn, "SELECT 0, engine_name FROM engine "
+                     "UNION ALL SELECT 1, engine_id || E'\\t' || version_name "
+                     "FROM version "
+                     "UNION ALL SELECT 2, license_name FROM license "
+                     "UNION ALL SELECT 3, code_lang_name FROM code_lang;");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return NULL;
+    }
+
+    name_index* index = errhandMalloc(sizeof(name_index));
+    for (int kind = 0; kind < TRIE_KIND_COUNT; kind++) {
+        trieInit(&index->tries[kind]);
+    }
+    for (int i = 0; i < PQntuples(res); i++) {
+        int kind = atoi(PQgetvalue(res, i, 0));
+        if (kind >= 0 && kind < TRIE_KIND_COUNT && !PQgetisnull(res, i, 1)) {
+            trieInsert(&index->tries[kind], PQgetvalue(res, i, 1));
+        }
+    }
+    PQclear(res);
+    return index;
+}
+
+void trieFreeNameIndex(name_index* index) {
+    if (index == NULL) {
+        return;
+    }
+    for (int kind = 0; kind < TRIE_KIND_COUNT; kind++) {
+        trieFree(&index->tries[kind]);
+    }
+    free(index);
+}
+
+name_index* trieObtainNameIndex(PGconn* conn) {
+    if (cached_index == NULL) {
+        cached_index = trieAllocNameIndex(conn);
+    }
+    return cached_index;
+}
+
+// Must be called after engines or versions are added, so the next
+// trieObtainNameIndex reloads the names.
+void trieInvalidate() {
+    trieFreeNameIndex(cached_index);
+    cached_index = NULL;
+}
+
+// Returns every name of kind starting with prefix, and sets count to their
+// number. Version names are looked up among those of the engine whose id is
+// scope, and returned without it. The array and each name in it must be
+// freed. Returns NULL if the names could not be loaded.
+char** trieAllocCompletions(PGconn* conn, trie_kind kind, const char* scope,
+                            const char* prefix, int* count) {
+    name_index* index = trieObtainNameIndex(conn);
+    *count = 0;
+    if (index == NULL) {
+        return NULL;
+    }
+    if (scope == NULL) {
+        return trieAllocWords(&index->tries[kind], prefix, count);
+    }
+
+    size_t scope_len = strlen(scope) + 1;
+    char*  key = errhandMalloc(scope_len + strlen(prefix) + 1);
+    sprintf(key, "%s\t%s", scope, prefix);
+    char** names = trieAllocWords(&index->tries[kind], key, count);
+    free(key);
+    for (int i = 0; i < *count; i++) {
+        memmove(names[i], names[i] + scope_len,
+                strlen(names[i] + scope_len) + 1);
+    }
+    return names;
+}
@@ -0,0 +1,66 @@
+/*
+Copyright 2023 En-En-Code
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef TRIEHELPERS_H
+#define TRIEHELPERS_H
+
+#include <libpq-fe.h>
+
+// A node of a byte-wise prefix trie. The children of a node are a list
+// linked through sibling, kept in byte order so words are found sorted.
+typedef struct {
+    int           child;
+    int           sibling;
+    unsigned char byte;
+    char          is_word;
+} trie_node;
+
+// All nodes live in one array, indexed from the root at nodes[0].
+typedef struct {
+    int        node_count;
+    int        node_cap;
+    trie_node* nodes;
+} trie;
+
+// The kinds of names which can be completed. Version names are only unique
+// within an engine, so they are stored as the engine id, a tab, then the name.
+typedef enum {
+    TRIE_ENGINE,
+    TRIE_VERSION,
+    TRIE_LICENSE,
+    TRIE_CODE_LANG,
+    TRIE_KIND_COUNT
+} trie_kind;
+
+typedef struct {
+    trie tries[TRIE_KIND_COUNT];
+} name_index;
+
+extern void   trieInit(trie* t);
+extern void   trieFree(trie* t);
+extern void   trieInsert(trie* t, const char* word);
+extern int    trieFind(const trie* t, const char* prefix);
+extern char** trieAllocWords(const trie* t, const char* prefix, int* count);
+
+extern name_index* trieAllocNameIndex(PGconn* conn);
+extern void        trieFreeNameIndex(name_index* index);
+extern name_index* trieObtainNameIndex(PGconn* conn);
+extern void        trieInvalidate();
+extern char**      trieAllocCompletions(PGconn* conn, trie_kind kind,
+                                        const char* scope, const char* prefix,
+                                        int* count);
+
+#endif
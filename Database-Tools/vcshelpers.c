@@ -15,7 +15,9 @@ limitations under the License.
 */
 
 #include "vcshelpers.h"
+#include "fmthelpers.h"
 #include "globals.h"
+#include "hashhelpers.h"
 #include "pqhelpers.h"
 #include <git2.h>
 #include <libpq-fe.h>
@@ -23,8 +25,11 @@ limitations under the License.
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <svn_client.h>
+#include <svn_cmdline.h>
 #include <svn_config.h>
 #include <svn_error.h>
 #include <svn_opt.h>
@@ -40,15 +45,95 @@ sem_t conn_lock;
 sem_t idx_lock;
 int   scan_idx;
 
+static pthread_once_t git_once = PTHREAD_ONCE_INIT;
+static pthread_once_t svn_once = PTHREAD_ONCE_INIT;
+static int            git_ready = 0;
+static int            svn_ready = 0;
+
+// A mirror fetched during this run, which need not be fetched again.
+typedef struct vcs_fetched {
+    struct vcs_fetched* next;
+    char                path[VCS_MIRROR_PATH_SIZE];
+} vcs_fetched;
+
+// Mirrors are shared out between these locks by the first digit of their
+// name, so no two scan threads use the same mirror at once. Each lock also
+// guards the list of mirrors fetched under it.
+#define VCS_MIRROR_LOCKS 16
+static pthread_mutex_t mirror_locks[VCS_MIRROR_LOCKS];
+static vcs_fetched*    mirrors_fetched[VCS_MIRROR_LOCKS];
+
+static pthread_mutex_t* vcsMirrorLock(const char* path);
+
+static void vcsInitGit() {
+    for (int i = 0; i < VCS_MIRROR_LOCKS; i++) {
+        pthread_mutex_init(&mirror_locks[i], NULL);
+    }
+    git_ready = git_libgit2_init() > 0;
+}
+
+static void vcsInitSvn() {
+    svn_ready = svn_cmdline_init("svn", stderr) == EXIT_SUCCESS;
+}
+
+// libgit2 and Subversion are initialized on first use rather than at startup,
+// so commands which never touch a repository do not pay for them. Both are
+// safe to call from several scan threads at once.
+// Returns 0 on success, or -1 if initialization failed.
+int vcsEnsureGit() {
+    pthread_once(&git_once, vcsInitGit);
+    return git_ready ? 0 : -1;
+}
+
+int vcsEnsureSvn() {
+    pthread_once(&svn_once, vcsInitSvn);
+    return svn_ready ? 0 : -1;
+}
+
+// Forgets that the mirror at path was fetched, or every mirror if path is
+// NULL, so the next use fetches it again. A mirror is only trusted to be
+// current for the length of one scan, not for the whole session.
+static void vcsForgetFetched(const char* path) {
+    for (int i = 0; i < VCS_MIRROR_LOCKS; i++) {
+        if (path != NULL && &mirror_locks[i] != vcsMirrorLock(path)) {
+            continue;
+        }
+        pthread_mutex_lock(&mirror_locks[i]);
+        vcs_fetched** entry = &mirrors_fetched[i];
+        while (*entry != NULL) {
+            if (path == NULL || !strcmp((*entry)->path, path)) {
+                vcs_fetched* next = (*entry)->next;
+                free(*entry);
+                *entry = next;
+            } else {
+                entry = &(*entry)->next;
+            }
+        }
+        pthread_mutex_unlock(&mirror_locks[i]);
+    }
+}
+
+// Shuts down whatever vcsEnsureGit and vcsEnsureSvn initialized. Subversion
+// registers its own clean-up to run at exit.
+void vcsShutdown() {
+    if (git_ready) {
+        vcsForgetFetched(NULL);
+        git_libgit2_shutdown();
+    }
+}
+
 // Returns the number of engines with updates found, or -1 on failure.
 int vcsUpdateScan(PGconn* conn) {
-    clock_t   start = clock();
+    clock_t start = clock();
     PGresult* res = pqAllocAllBranchRevisions(conn);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "SELECT failed: %s\n", PQerrorMessage(conn));
         PQclear(res);
         return -1;
     }
+    if (git_ready) {
+        vcsForgetFetched(NULL);
+    }
     if (pqCreateUpdateTable(conn) == -1) {
         PQclear(res);
         return -1;
@@ -73,16 +158,17 @@ int vcsUpdateScan(PGconn* conn) {
     }
 
     PQclear(res);
-    printf("\n");
+    fmtStatus("\n");
     pqSummarizeUpdateTable(conn);
-    pqDropUpdateTable(conn);
+    pqUnlockUpdateTable(conn);
 
     sem_destroy(&conn_lock);
     sem_destroy(&idx_lock);
     free(td);
     clock_t end = clock();
     double  len = (end - start) * 1000 / CLOCKS_PER_SEC;
-    printf("\nCPU time: %.1f ms\n", len);
+    fmtStatus("\nCPU time: %.1f ms\n", len);
+    errhandPrintMemStats(fmtStatusStream());
 
     return update_count;
 }
@@ -95,6 +181,10 @@ void* vcsUpdateScanThread(void* td) {
     PGconn*   conn = thread_info->conn;
     int       tuples = PQntuples(res);
     int       update_count = 0;
+    // Everything allocated while checking an engine is released at once
+    // before moving on to the next.
+    arena scratch;
+    arenaInit(&scratch, 4096);
 
     sem_wait(&idx_lock);
     int i = scan_idx;
@@ -102,29 +192,30 @@ void* vcsUpdateScanThread(void* td) {
     sem_post(&idx_lock);
     while (i < tuples) {
         // Read vcs_name to decide what to do.
-        char*     vcs_name = PQgetvalue(res, i, 4);
-        revision* rev;
+        char* vcs_name = PQgetvalue(res, i, 4);
+        char  source_id[12];
+        snprintf(source_id, 12, "%d", pqGetIntValue(res, i, 6));
+        // The revision only borrows from res, which outlives the scan.
+        revision rev =
+            borrowRevision(source_id, PQgetvalue(res, i, 2),
+                           PQgetvalue(res, i, 3), PQgetisnull(res, i, 3));
         if (strncmp(vcs_name, "git", 3) == 0) {
-            rev = allocRevision(PQgetvalue(res, i, 6), PQgetvalue(res, i, 2),
-                                PQgetvalue(res, i, 3), PQgetisnull(res, i, 3));
             time_t commit_time =
-                vcsRevisionCommitTimeGit(rev, PQgetvalue(res, i, 1));
+                vcsRevisionCommitTimeGit(&rev, PQgetvalue(res, i, 1), &scratch);
             update_count += vcsScanDateHelper(conn, res, i, commit_time);
-            freeRevision(*rev);
-            free(rev);
         } else if (strncmp(vcs_name, "svn", 3) == 0) {
+            if (vcsEnsureSvn() == -1) {
+                fprintf(stderr, "Subversion could not be initialized.\n");
+                break;
+            }
             apr_pool_t* pool = svn_pool_create(NULL);
-            rev = allocRevision(PQgetvalue(res, i, 6), PQgetvalue(res, i, 2),
-                                PQgetvalue(res, i, 3), PQgetisnull(res, i, 3));
-            time_t commit_time =
-                vcsRevisionCommitTimeSvn(rev, PQgetvalue(res, i, 1), pool);
+            time_t      commit_time =
+                vcsRevisionCommitTimeSvn(&rev, PQgetvalue(res, i, 1), pool);
             update_count += vcsScanDateHelper(conn, res, i, commit_time);
             svn_pool_destroy(pool);
-            freeRevision(*rev);
-            free(rev);
         } else if (strncmp(vcs_name, "n/a", 3) == 0) {
             sem_wait(&conn_lock);
-            pqInsertUpdate(conn, PQgetvalue(res, i, 0));
+            pqInsertUpdate(conn, pqGetIntValue(res, i, 0));
             sem_post(&conn_lock);
             fflush(stdout);
         } else if (strncmp(vcs_name, "rhv", 3) != 0) {
@@ -134,11 +225,13 @@ void* vcsUpdateScanThread(void* td) {
                     PQgetvalue(res, i, 1));
             fflush(stderr);
         }
+        arenaReset(&scratch);
         sem_wait(&idx_lock);
         i = scan_idx;
         scan_idx += 1;
         sem_post(&idx_lock);
     }
+    arenaFree(&scratch);
     thread_info->count = update_count;
     return NULL; // I don't need anything returned really.
 }
@@ -149,21 +242,28 @@ void* vcsUpdateScanThread(void* td) {
 int vcsScanDateHelper(PGconn* conn, PGresult* res, int idx,
                       time_t commit_time) {
     int ret = 0;
-    sem_wait(&conn_lock);
-    char* stored_date_str =
-        pqAllocLatestVersionDate(conn, PQgetvalue(res, idx, 5));
-    sem_post(&conn_lock);
-    time_t stored_time = readDate(stored_date_str);
-    free(stored_date_str);
+    // The latest release date comes with the scanned revisions, so no query
+    // is needed. An engine without versions is always considered outdated.
+    // Otherwise, as with readDate, the date is compared as the local midnight
+    // ending it, so commits made on the release date are not newer than it.
+    time_t stored_time = 0;
+    if (!PQgetisnull(res, idx, 7)) {
+        time_t    day_start = (time_t)pqGetDateValue(res, idx, 7) * 86400;
+        struct tm stored_date;
+        gmtime_r(&day_start, &stored_date);
+        stored_date.tm_mday += 1;
+        stored_date.tm_isdst = 0;
+        stored_time = mktime(&stored_date);
+    }
 
     if (commit_time > stored_time) {
         sem_wait(&conn_lock);
-        pqInsertUpdate(conn, PQgetvalue(res, idx, 0));
+        pqInsertUpdate(conn, pqGetIntValue(res, idx, 0));
         sem_post(&conn_lock);
         ret = 1;
-        printf("!");
+        fmtStatus("!");
     } else {
-        printf(".");
+        fmtStatus(".");
     }
     fflush(stdout);
     return ret;
@@ -180,7 +280,18 @@ int vcsUpdateRevisionInfo(PGconn* conn, char* version_id, code_link* source) {
                 "Revision info could not be obtained from the version info.\n");
             return -1;
         }
-        git_commit* commit = vcsAllocRevisionCommitGit(rev, source->uri);
+        // A pull of a single version always fetches, whatever was fetched
+        // earlier in the session.
+        if (git_ready) {
+            char path[VCS_MIRROR_PATH_SIZE];
+            vcsMirrorPath(source->uri, path);
+            vcsForgetFetched(path);
+        }
+        arena scratch;
+        arenaInit(&scratch, 1024);
+        git_commit* commit =
+            vcsAllocRevisionCommitGit(rev, source->uri, &scratch);
+        arenaFree(&scratch);
         freeRevision(*rev);
         free(rev);
         if (commit == NULL) {
@@ -204,6 +315,10 @@ int vcsUpdateRevisionInfo(PGconn* conn, char* version_id, code_link* source) {
         free(note);
         git_commit_free(commit);
     } else if (strncmp(source->vcs, "svn", 3) == 0) {
+        if (vcsEnsureSvn() == -1) {
+            fprintf(stderr, "Subversion could not be initialized.\n");
+            return -1;
+        }
         apr_pool_t* pool = svn_pool_create(NULL);
         revision*   rev = pqAllocRevisionFromVersion(conn, version_id);
         if (rev == NULL) {
@@ -218,8 +333,6 @@ int vcsUpdateRevisionInfo(PGconn* conn, char* version_id, code_link* source) {
         free(rev);
         if (commit == NULL) {
             svn_pool_destroy(pool);
-            freeCodeLink(*source);
-            free(source);
             return -1;
         }
 
@@ -250,8 +363,8 @@ int vcsUpdateRevisionInfo(PGconn* conn, char* version_id, code_link* source) {
 }
 
 // Returns time of last commit, or negative numbers for errors.
-time_t vcsRevisionCommitTimeGit(revision* rev, char* uri) {
-    git_commit* commit = vcsAllocRevisionCommitGit(rev, uri);
+time_t vcsRevisionCommitTimeGit(revision* rev, char* uri, arena* scratch) {
+    git_commit* commit = vcsAllocRevisionCommitGit(rev, uri, scratch);
     if (commit == NULL) {
         return -1;
     }
@@ -272,97 +385,339 @@ time_t vcsRevisionCommitTimeSvn(revision* rev, char* uri, apr_pool_t* pool) {
         svn_prop_get_value(commit->revprops, SVN_PROP_REVISION_DATE));
 }
 
-// Returns a pointer to the last git commit made to HEAD in uri. Must be freed.
-git_commit* vcsAllocRevisionCommitGit(revision* rev, char* uri) {
-    size_t size = 256;
-    char*  path = errhandMalloc(size);
-    while (getcwd(path, size - 12) == NULL) {
-        size *= 2;
-        path = errhandRealloc(path, size);
-    }
-    strcat(path, "/tempXXXXXX");
-    path = mkdtemp(path);
-    if (path == NULL) {
-        fprintf(stderr, "Temporary filepath not created sucessfully.\n");
-        return NULL;
+// Finds the commit rev currently refers to in the git repository at uri by
+// listing its references, which is far cheaper than cloning.
+// Returns 0 on success, or -1 on failure.
+static int vcsResolveRevisionGit(revision* rev, char* uri, char* id) {
+    if (rev->type == 2) {
+        snprintf(id, VCS_REVISION_ID_SIZE, "%s", rev->val);
+        return 0;
     }
-
-    git_clone_options clone_opts = GIT_CLONE_OPTIONS_INIT;
-    git_repository*   repo = NULL;
-    const char*       url = uri;
-    char              frag_type = rev->type;
-    if (frag_type == 4) {
+    if (rev->type == 4) {
         fprintf(stderr, "Revision number is not a valid identifier in Git.\n");
-        return NULL;
+        return -1;
+    }
+    if (vcsEnsureGit() == -1) {
+        fprintf(stderr, "libgit2 could not be initialized.\n");
+        return -1;
+    }
+    // An annotated tag is listed twice, and its peeled name (with ^{}
+    // appended) gives the commit rather than the tag object.
+    char ref_name[300];
+    char peeled_name[304];
+    if (rev->type == 1) {
+        snprintf(ref_name, 300, rev->val ? "refs/heads/%s" : "HEAD", rev->val);
+    } else {
+        snprintf(ref_name, 300, "refs/tags/%s", rev->val);
+    }
+    snprintf(peeled_name, 304, "%s^{}", ref_name);
+
+    git_remote* remote = NULL;
+    int         err = git_remote_create_detached(&remote, uri);
+    if (err == 0) {
+        err = git_remote_connect(remote, GIT_DIRECTION_FETCH, NULL, NULL, NULL);
+    }
+    const git_remote_head** heads;
+    size_t                  head_count = 0;
+    if (err == 0) {
+        err = git_remote_ls(&heads, &head_count, remote);
+    }
+    if (err < 0) {
+        const git_error* e = git_error_last();
+        fprintf(stderr, "Error %d/%d: %s\n", err, e->klass, e->message);
+        git_remote_free(remote);
+        return -1;
     }
 
-    clone_opts.checkout_opts.checkout_strategy = GIT_CHECKOUT_NONE;
-    // Shallow cloning!! :D
-    // Use cutting-edge libgit2 (https://github.com/libgit2/libgit2/pull/6557)
-    // This, on my then-current database of ~50 engines, reduced the CPU time of
-    // vcsUpdateScan from 42.094 s to 11.276 s !
-    // Caveat: This may not work for commit hash-based checks. Will test.
-    clone_opts.fetch_opts.depth = 1;
-    if (frag_type == 8) {
-        clone_opts.fetch_opts.download_tags = GIT_REMOTE_DOWNLOAD_TAGS_ALL;
+    const git_remote_head* found = NULL;
+    for (size_t i = 0; i < head_count; i++) {
+        if (!strcmp(heads[i]->name, peeled_name)) {
+            found = heads[i];
+            break;
+        }
+        if (!strcmp(heads[i]->name, ref_name)) {
+            found = heads[i];
+        }
+    }
+    if (found == NULL) {
+        fprintf(stderr, "%s has no reference %s.\n", uri, ref_name);
     } else {
-        clone_opts.fetch_opts.download_tags = GIT_REMOTE_DOWNLOAD_TAGS_NONE;
+        git_oid_tostr(id, VCS_REVISION_ID_SIZE, &found->oid);
     }
+    git_remote_free(remote);
+    return found ? 0 : -1;
+}
+
+// Writes an identifier of the revision rev currently refers to in the
+// repository at uri to id, which must hold VCS_REVISION_ID_SIZE bytes: the
+// commit hash for git, or r and the revision number for svn. Nothing is
+// fetched besides the identifier.
+// Returns 0 on success, or -1 if the revision could not be resolved.
+int vcsResolveRevision(revision* rev, char* uri, const char* vcs_name,
+                       char* id) {
+    if (strncmp(vcs_name, "git", 3) == 0) {
+        return vcsResolveRevisionGit(rev, uri, id);
+    }
+    if (strncmp(vcs_name, "svn", 3) == 0) {
+        if (vcsEnsureSvn() == -1) {
+            fprintf(stderr, "Subversion could not be initialized.\n");
+            return -1;
+        }
+        apr_pool_t* pool = svn_pool_create(NULL);
+        svn_commit* commit = vcsAllocRevisionCommitSvn(rev, uri, pool);
+        if (commit != NULL) {
+            snprintf(id, VCS_REVISION_ID_SIZE, "r%ld", commit->rev_num);
+        }
+        svn_pool_destroy(pool);
+        return commit ? 0 : -1;
+    }
+    // Archives and plain downloads have nothing to identify a revision by.
+    return -1;
+}
+
+// Writes the path of the mirror of the git repository at uri to path, which
+// must hold VCS_MIRROR_PATH_SIZE bytes. The name is taken from the hash of
+// uri without a trailing slash or .git, so both spellings share a mirror.
+void vcsMirrorPath(const char* uri, char* path) {
+    size_t len = strlen(uri);
+    while (len > 0 && uri[len - 1] == '/') {
+        len--;
+    }
+    if (len >= 4 && !strncmp(uri + len - 4, ".git", 4)) {
+        len -= 4;
+    }
+    unsigned char digest[HASH_SHA256_SIZE];
+    char          hex[2 * HASH_SHA256_SIZE + 1];
+    hashSha256(uri, len, digest);
+    hashToHex(digest, HASH_SHA256_SIZE, hex);
+    snprintf(path, VCS_MIRROR_PATH_SIZE, VCS_SOURCE_ROOT "/%.16s.git", hex);
+}
 
-    int err = git_clone(&repo, url, path, &clone_opts);
+// Returns the lock guarding the mirror at path, named by vcsMirrorPath.
+static pthread_mutex_t* vcsMirrorLock(const char* path) {
+    char digit = path[sizeof(VCS_SOURCE_ROOT)];
+    return &mirror_locks[digit <= '9' ? digit - '0' : digit - 'a' + 10];
+}
+
+// Fetches every branch and tag of the origin of the mirror repo, and points
+// its HEAD at the default branch of the origin, which is not under refs/.
+// Returns 0 on success, or a libgit2 error code on failure.
+static int vcsFetchMirror(git_repository* repo) {
+    git_remote*          remote = NULL;
+    git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
+    git_buf              head = GIT_BUF_INIT;
+    int                  err = git_remote_lookup(&remote, repo, "origin");
+    if (err == 0) {
+        err = git_remote_connect(remote, GIT_DIRECTION_FETCH, &callbacks, NULL,
+                                 NULL);
+    }
+    if (err == 0) {
+        err = git_remote_default_branch(&head, remote);
+    }
+    if (err == 0) {
+        err = git_remote_download(remote, NULL, NULL);
+    }
+    if (err == 0) {
+        err = git_remote_update_tips(remote, &callbacks, 0,
+                                     GIT_REMOTE_DOWNLOAD_TAGS_NONE, NULL);
+    }
+    if (err == 0) {
+        err = git_repository_set_head(repo, head.ptr);
+    }
+    git_buf_dispose(&head);
+    git_remote_free(remote);
+    return err;
+}
+
+// Opens the bare mirror at path of the git repository at uri, creating it if
+// needed, and brings it up to date unless it already was during this run.
+// Mirrors persist under VCS_SOURCE_ROOT, so later scans only fetch what has
+// changed, and builds clone them instead of the repository (see
+// pkg-run-makepkg.sh). The caller must hold the lock of the mirror.
+// Returns the repository, or NULL on failure. Must be freed.
+static git_repository* vcsOpenMirror(char* uri, const char* path) {
+    git_repository* repo = NULL;
+    int             err = git_repository_open_bare(&repo, path);
+    if (err == GIT_ENOTFOUND) {
+        mkdir(VCS_SOURCE_ROOT, 0777);
+        git_remote* remote = NULL;
+        err = git_repository_init(&repo, path, 1);
+        if (err == 0) {
+            err = git_remote_create_with_fetchspec(
+                &remote, repo, "origin", uri, "+refs/heads/*:refs/heads/*");
+        }
+        if (err == 0) {
+            err = git_remote_add_fetch(repo, "origin",
+                                       "+refs/tags/*:refs/tags/*");
+        }
+        git_remote_free(remote);
+    }
+
+    vcs_fetched** fetched = &mirrors_fetched[vcsMirrorLock(path) -
+                                             mirror_locks];
+    vcs_fetched*  entry = *fetched;
+    while (entry != NULL && strcmp(entry->path, path)) {
+        entry = entry->next;
+    }
+    if (err == 0 && entry == NULL) {
+        err = vcsFetchMirror(repo);
+        if (err == 0) {
+            entry = errhandMalloc(sizeof(vcs_fetched));
+            strcpy(entry->path, path);
+            entry->next = *fetched;
+            *fetched = entry;
+        }
+    }
     if (err < 0) {
         const git_error* e = git_error_last();
         fprintf(stderr, "Error %d/%d: %s\n", err, e->klass, e->message);
-        rm_file_recursive(path);
-        free(path);
+        git_repository_free(repo);
+        return NULL;
+    }
+    return repo;
+}
+
+// Opens the mirror of uri, fetching it first if this run has not, and writes
+// the commit rev refers to to oid. Returns the mirror, which must be freed,
+// or NULL on failure. Reference names are allocated from scratch, which the
+// caller resets or frees afterwards.
+static git_repository* vcsOpenRevisionGit(revision* rev, char* uri,
+                                          arena* scratch, git_oid* oid) {
+    if (vcsEnsureGit() == -1) {
+        fprintf(stderr, "libgit2 could not be initialized.\n");
+        return NULL;
+    }
+    char frag_type = rev->type;
+    if (frag_type == 4) {
+        fprintf(stderr, "Revision number is not a valid identifier in Git.\n");
+        return NULL;
+    }
+    char path[VCS_MIRROR_PATH_SIZE];
+    vcsMirrorPath(uri, path);
+    pthread_mutex_t* lock = vcsMirrorLock(path);
+    pthread_mutex_lock(lock);
+    git_repository* repo = vcsOpenMirror(uri, path);
+    // Only the fetch needs the lock. Once it is done, each thread reads the
+    // mirror through its own repository.
+    pthread_mutex_unlock(lock);
+    if (repo == NULL) {
         return NULL;
     }
 
-    git_oid oid;
+    int err;
     if (frag_type == 1) {
-        if (rev->val) {
-            char* template = errhandStrdup("refs/remotes/origin/");
-            template = errhandRealloc(template, 21 + strlen(rev->val));
-            strcat(template, rev->val);
-            err = git_reference_name_to_id(&oid, repo, template);
-            free(template);
-        } else {
-            err = git_reference_name_to_id(&oid, repo, "HEAD");
-        }
+        const char* ref_name =
+            rev->val ? arenaSprintf(scratch, "refs/heads/%s", rev->val)
+                     : "HEAD";
+        err = git_reference_name_to_id(oid, repo, ref_name);
     } else if (frag_type == 2) {
-        err = git_oid_fromstr(&oid, rev->val);
+        err = git_oid_fromstr(oid, rev->val);
     } else {
-        char* template = errhandStrdup("refs/tags/");
-        template = errhandRealloc(template, 11 + strlen(rev->val));
-        strcat(template, rev->val);
-        err = git_reference_name_to_id(&oid, repo, template);
-        free(template);
+        err = git_reference_name_to_id(
+            oid, repo, arenaSprintf(scratch, "refs/tags/%s", rev->val));
     }
     if (err < 0) {
         const git_error* e = git_error_last();
         fprintf(stderr, "Error %d/%d: %s", err, e->klass, e->message);
         git_repository_free(repo);
-        rm_file_recursive(path);
-        free(path);
         return NULL;
     }
+    return repo;
+}
 
+// Returns a pointer to the commit rev refers to in uri, read from the mirror
+// of uri. Must be freed. Reference names are allocated from scratch, which the
+// caller resets or frees afterwards.
+git_commit* vcsAllocRevisionCommitGit(revision* rev, char* uri,
+                                      arena* scratch) {
+    git_oid         oid;
+    git_repository* repo = vcsOpenRevisionGit(rev, uri, scratch, &oid);
+    if (repo == NULL) {
+        return NULL;
+    }
     git_commit* commit = NULL;
-    err = git_commit_lookup(&commit, repo, &oid);
+    int         err = git_commit_lookup(&commit, repo, &oid);
     if (err < 0) {
         const git_error* e = git_error_last();
         fprintf(stderr, "Error %d/%d: %s", err, e->klass, e->message);
+    }
+    git_repository_free(repo);
+
+    return commit;
+}
+
+// What vcsWalkFile needs from vcsWalkRevisionGit.
+typedef struct {
+    git_repository* repo;
+    vcs_file_fn     visit;
+    void*           payload;
+    arena*          scratch;
+} vcs_walk;
+
+// Helper function to vcsWalkRevisionGit, called by git_tree_walk for every
+// entry of the tree. Submodules and files git considers binary are skipped.
+static int vcsWalkFile(const char* root, const git_tree_entry* entry,
+                       void* payload) {
+    vcs_walk* walk = payload;
+    if (git_tree_entry_type(entry) != GIT_OBJECT_BLOB) {
+        return 0;
+    }
+    git_blob* blob;
+    if (git_blob_lookup(&blob, walk->repo, git_tree_entry_id(entry)) < 0) {
+        return 0;
+    }
+    if (!git_blob_is_binary(blob)) {
+        char* path =
+            arenaSprintf(walk->scratch, "%s%s", root,
+                         git_tree_entry_name(entry));
+        walk->visit(path, (const char*)git_blob_rawcontent(blob),
+                    (size_t)git_blob_rawsize(blob), walk->payload);
+    }
+    git_blob_free(blob);
+
+    return 0;
+}
+
+// Calls visit with every text file of the tree of the commit rev refers to in
+// uri, read from the mirror of uri without checking it out. The hex of the
+// commit is written to id, which must hold GIT_OID_HEXSZ + 1 bytes. If it is
+// known_id, the tree is not walked, since it is what was walked before.
+// Returns 0 if the tree was walked, 1 if it was known, or -1 on failure.
+// Paths are allocated from scratch, which the caller resets or frees
+// afterwards.
+int vcsWalkRevisionGit(revision* rev, char* uri, const char* known_id,
+                       char* id, arena* scratch, vcs_file_fn visit,
+                       void* payload) {
+    git_oid         oid;
+    git_repository* repo = vcsOpenRevisionGit(rev, uri, scratch, &oid);
+    if (repo == NULL) {
+        return -1;
+    }
+    git_oid_tostr(id, GIT_OID_HEXSZ + 1, &oid);
+    if (known_id != NULL && !strcmp(id, known_id)) {
         git_repository_free(repo);
-        rm_file_recursive(path);
-        free(path);
-        return NULL;
+        return 1;
     }
 
+    git_commit* commit = NULL;
+    git_tree*   tree = NULL;
+    int         err = git_commit_lookup(&commit, repo, &oid);
+    if (err == 0) {
+        err = git_commit_tree(&tree, commit);
+    }
+    if (err == 0) {
+        vcs_walk walk = {repo, visit, payload, scratch};
+        err = git_tree_walk(tree, GIT_TREEWALK_PRE, vcsWalkFile, &walk);
+    }
+    if (err < 0) {
+        const git_error* e = git_error_last();
+        fprintf(stderr, "Error %d/%d: %s", err, e->klass, e->message);
+    }
+    git_tree_free(tree);
+    git_commit_free(commit);
     git_repository_free(repo);
-    rm_file_recursive(path);
-    free(path);
 
-    return commit;
+    return err < 0 ? -1 : 0;
 }
 
 // Memory is allocated by pool, which must be freed when finished.
@@ -23,18 +23,36 @@ limitations under the License.
 #include <libpq-fe.h>
 #include <svn_types.h>
 
+// Enough for a SHA-256 git commit hash, or an svn revision number.
+#define VCS_REVISION_ID_SIZE 72
+
+// The directory holding a bare mirror of every git repository scanned, which
+// builds fetch their sources from.
+#define VCS_SOURCE_ROOT "sources"
+// Enough for VCS_SOURCE_ROOT, a slash, 16 hex digits and .git.
+#define VCS_MIRROR_PATH_SIZE (sizeof(VCS_SOURCE_ROOT) + 21)
+
 // Why revprops couldn't just contain the revision number is beyond me
 typedef struct {
     apr_hash_t*  revprops;
     svn_revnum_t rev_num;
 } svn_commit;
 
+// Called by vcsWalkRevisionGit with the path of a file from the root of the
+// tree walked, and its contents.
+typedef void (*vcs_file_fn)(const char* path, const char* data, size_t size,
+                            void* payload);
+
 typedef struct {
     PGresult* res;
     PGconn*   conn;
     int       count;
 } scan_thread_info;
 
+extern int  vcsEnsureGit();
+extern int  vcsEnsureSvn();
+extern void vcsShutdown();
+
 extern int       vcsUpdateScan(PGconn* conn);
 extern void*     vcsUpdateScanThread(void* td);
 extern int       vcsScanDateHelper(PGconn* conn, PGresult* res, int idx,
@@ -43,11 +61,21 @@ extern int       vcsUpdateRevisionInfo(PGconn* conn, char* version_id,
                                        code_link* source);
 extern revision* vcsAllocScannedRevision(PGresult* res, int idx);
 
-extern time_t vcsRevisionCommitTimeGit(revision* rev, char* uri);
+extern time_t vcsRevisionCommitTimeGit(revision* rev, char* uri,
+                                       arena* scratch);
 extern time_t vcsRevisionCommitTimeSvn(revision* rev, char* uri,
                                        apr_pool_t* pool);
 
-extern git_commit* vcsAllocRevisionCommitGit(revision* rev, char* uri);
+extern void vcsMirrorPath(const char* uri, char* path);
+extern int  vcsResolveRevision(revision* rev, char* uri,
+                               const char* vcs_name, char* id);
+
+extern git_commit* vcsAllocRevisionCommitGit(revision* rev, char* uri,
+                                             arena* scratch);
+extern int         vcsWalkRevisionGit(revision* rev, char* uri,
+                                      const char* known_id, char* id,
+                                      arena* scratch, vcs_file_fn visit,
+                                      void* payload);
 extern svn_commit* vcsAllocRevisionCommitSvn(revision* rev, char* uri,
                                              apr_pool_t* pool);
 